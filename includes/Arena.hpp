@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+
+/*
+** Scratch memory owned by one search thread. Blocks are handed out by
+** bumping an offset and given back in bulk by rewinding to an earlier
+** mark, so search frames never go through the global heap.
+*/
+class Arena
+{
+public:
+	explicit Arena(size_t bytes): _memory(new char[bytes]), _size(bytes), _used(0) {}
+	~Arena() { delete[] _memory; }
+
+	// Uninitialised room for count objects of type T
+	template <typename T>
+	T*		allocate(size_t count);
+
+	size_t	mark() const { return _used; }
+	void	rewind(size_t mark) { _used = mark; }
+	void	reset() { _used = 0; }
+
+private:
+	char*	_memory;
+	size_t	_size;
+	size_t	_used;
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+};
+
+// Gives back everything allocated from the arena during its lifetime
+class ArenaScope
+{
+public:
+	explicit ArenaScope(Arena& arena): _arena(arena), _mark(arena.mark()) {}
+	~ArenaScope() { _arena.rewind(_mark); }
+
+private:
+	Arena&	_arena;
+	size_t	_mark;
+
+	ArenaScope(const ArenaScope&);
+	ArenaScope& operator=(const ArenaScope&);
+};
+
+template <typename T>
+T* Arena::allocate(size_t count)
+{
+	size_t start = (_used + alignof(T) - 1) & ~(alignof(T) - 1);
+
+	if (start + count * sizeof(T) > _size)
+		throw std::bad_alloc();
+	_used = start + count * sizeof(T);
+	return reinterpret_cast<T*>(_memory + start);
+}
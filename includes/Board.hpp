@@ -7,10 +7,13 @@ class Board;
 
 #include <vector>
 #include <tuple>
+#include <cstddef>
+#include <cstdint>
 #include "Constants.hpp"
 #include "BoardPos.hpp"
+#include "BoardLine.hpp"
 #include "PlayerColor.hpp"
-#include "Options.hpp"
+#include "Rules.hpp"
 
 enum BoardSquare
 {
@@ -19,7 +22,8 @@ enum BoardSquare
 	white = 2,
 };
 
-using BoardData = BoardSquare[BOARD_HEIGHT][BOARD_WIDTH];
+// Stones of each color (black then white), one word per line of the board
+using BoardData = LineBits[2][LINE_COUNT];
 using BoardScore = short[BOARD_HEIGHT][BOARD_WIDTH];
 
 enum VictoryType
@@ -40,6 +44,16 @@ struct VictoryState
 	VictoryState():victor(nullPlayer),type(novictory){};
 };
 
+// What a stone makes along one line, see Board::getPatternCells
+enum PatternClass
+{
+	patternFive = 1,
+	patternFreeThree = 2,
+	// Four stones of a five cells window, the fifth at one end or inside
+	patternFour = 4,
+	patternBrokenFour = 8,
+};
+
 struct MoveScore
 {
 	Score score;
@@ -50,13 +64,36 @@ struct MoveScore
 	MoveScore():score(),pos(){}
 };
 
-struct ChildBoard
+// Everything Board::unmakeMove needs to take back the move it describes
+struct MoveUndo
 {
-	Board *board;
-	BoardPos move;
+	BoardPos		move;
+	PlayerColor		player;
+	int				captureCount;
+	BoardPos		captured[16];
+	int				capturedWhites;
+	int				capturedBlacks;
+	int				turnNum;
+	PlayerColor		turn;
+	PlayerColor		victoryFlag;
+	BoardPos		alignmentPos;
+	VictoryState	victoryState;
+};
 
-	ChildBoard():board(),move(){};
-	ChildBoard(Board *_board, BoardPos _move):board(_board),move(_move){};
+/*
+** What the stones imply, kept apart from the position itself: setCase keeps
+** it up to date while it is valid, a board copied without it rebuilds it the
+** first time it is asked for.
+*/
+struct BoardCache
+{
+	BoardScore		priority;
+	// Directions in which a stone of each colour on the cell makes a free three
+	unsigned char	threes[2][BOARD_HEIGHT][BOARD_WIDTH];
+	Score			score;
+	bool			capturePriority;
+	bool			doubleThree;
+	bool			valid;
 };
 
 class Board
@@ -65,36 +102,61 @@ class Board
 public:
 	Board(PlayerColor player);
 	Board(const Board& board);
-	Board(const Board& board, BoardPos move, PlayerColor player, const Options& options);
+	Board(const Board& board, bool withCache);
+	Board(const Board& board, BoardPos move, PlayerColor player, const Rules& rules);
 	virtual ~Board();
 
+	void 			makeMove(BoardPos move, PlayerColor player, const Rules& rules, MoveUndo& undo);
+	void 			unmakeMove(const MoveUndo& undo);
+
 	VictoryState	getVictory();
 	size_t			getChildren(MoveScore* buffer, size_t count);
 
-	void 			fillTaboo(bool doubleThree, PlayerColor player);
-	void 			fillPriority(const Options& options);
+	void 			setDoubleThree(bool doubleThree);
+	bool			isTaboo(int x, int y) const;
+	void 			fillPriority(const Rules& rules);
 	MoveScore		getBestPriority() const;
-	bool			checkFreeThree(int x, int y, int dirX, int dirY, BoardSquare enemy);
-	int 			playCapture(int x, int y);
+	bool			checkFreeThree(int x, int y, LineDirection dir, BoardSquare enemy) const;
+	int 			playCapture(int x, int y, MoveUndo* undo = nullptr);
 	bool			isAlignedStone(int size) const;
 
 	Score			fillScore();
-	Score			getScore(bool considerCapture);
-
-	BoardData*		getData() { return &_data; }
-	BoardSquare		getCase(BoardPos pos) const { return (_data[pos.y][pos.x]); }
-	BoardSquare&	getCase(BoardPos pos) { return (_data[pos.y][pos.x]); }
-	BoardSquare		getCase(int x, int y) const {return (_data[y][x]);};
-	BoardSquare&	getCase(int x, int y) {return (_data[y][x]);};
+	Score			getScore(bool considerCapture) const;
+
+	const BoardData*	getData() const { return &_data; }
+	BoardSquare		getCase(BoardPos pos) const { return getCase(pos.x, pos.y); }
+	BoardSquare		getCase(int x, int y) const
+	{
+		if ((_data[black - 1][y] >> x) & 1)
+			return black;
+		if ((_data[white - 1][y] >> x) & 1)
+			return white;
+		return empty;
+	}
+	void 			setCase(int x, int y, BoardSquare square);
 	int 			getCapturedBlack() const {return (_capturedBlacks);}
 	int 			getCapturedWhite() const {return (_capturedWhites);}
-	int 			getPriority(int x, int y) const {return _priority[y][x];}
-	int 			getPriority(BoardPos pos) const {return _priority[pos.y][pos.x];}
+	int 			getPriority(int x, int y) const
+	{
+		if (!_cache.valid)
+			refreshCache();
+		return isTaboo(x, y) ? -1 : _cache.priority[y][x];
+	}
+	int 			getPriority(BoardPos pos) const {return getPriority(pos.x, pos.y);}
 	bool 			isFlaggedFinal() const { return _victoryFlag; };
+	uint64_t		getHash() const;
+
+	// Lines where the player can take a pair, and the cells of a line doing it
+	const LineSet&	getCaptureLines(PlayerColor player) const { return _captureLines[player == whitePlayer]; }
+	LineBits		getCaptureCells(int index, PlayerColor player) const;
+	// Empty cells of a line where a stone of the player makes one of the classes
+	LineBits		getPatternCells(int index, PlayerColor player, int classes) const;
+	bool			isFiveBreakable(PlayerColor owner) const;
 
 private:
+	// The position: what search copies, hashes and takes back
 	BoardData		_data;
-	BoardScore		_priority;
+	uint64_t		_hash;
 	int				_capturedWhites;
 	int				_capturedBlacks;
 	int 			_turnNum;
@@ -102,17 +164,26 @@ private:
 	PlayerColor 	_victoryFlag;
 	BoardPos		_alignmentPos;
 	VictoryState	_victoryState;
-
-	VictoryState	calculateVictory(BoardPos pos, const Options& options);
-
-	void 			fillPriorityDir(int x, int y, int dirX, int dirY, BoardSquare color);//, int bonus);
-	void 			fillCapturePriorityDir(int x, int y, int dirX, int dirY, BoardSquare color);
-
-	bool 			isAlignedStoneDir(int x, int y, int dirX, int dirY, BoardSquare good, int size) const;
-	bool		 	isAlignedStonePos(int x, int y, int size) const;
-	bool 			playCaptureDir(int x, int y, int dirX, int dirY, BoardSquare type);
+	// Kept by setCase from the four lines it changes, per colour
+	LineSet			_captureLines[2];
+	LineSet			_fiveLines[2];
+
+	mutable BoardCache	_cache;
+
+	VictoryState	calculateVictory(BoardPos pos, const Rules& rules);
+	Score			lineScore(int index, LineBits stones) const;
+	Score			scalarBoardScore() const;
+	Score			boardScore() const;
+
+	void 			spreadPriority(int index, LineBits stones, int sign) const;
+	void			markThrees(int index, LineBits cells) const;
+	void			refreshCache() const;
+
+	bool			isFive(int x, int y) const;
+	void			trackLine(int index);
+	int				mostPairsTaken(PlayerColor player) const;
+	bool 			playCaptureDir(BoardLine line, int step, BoardSquare type) const;
+	void 			removePair(BoardLine line, int step, MoveUndo* undo);
 };
 
-#include "../srcs/Board.cpp"
-
 #endif
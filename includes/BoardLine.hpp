@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include "Constants.hpp"
+
+using LineBits = uint32_t;
+
+enum LineDirection
+{
+	lineRow = 0,
+	lineColumn = 1,
+	lineDiagonal = 2,
+	lineAntiDiagonal = 3,
+};
+
+#define LINE_DIRECTIONS 4
+#define DIAGONAL_COUNT (BOARD_WIDTH + BOARD_HEIGHT - 1)
+#define LINE_COUNT (BOARD_HEIGHT + BOARD_WIDTH + 2 * DIAGONAL_COUNT)
+
+/*
+** A line of the board packed in a word: bit n is the cell whose coordinate
+** along the line is n (x for rows, y for columns and both diagonals).
+** Rows come first, then columns, diagonals (1, 1) and anti-diagonals (-1, 1).
+*/
+struct BoardLine
+{
+	int index;
+	int bit;
+
+	constexpr BoardLine(int _index, int _bit): index(_index), bit(_bit) {};
+	constexpr BoardLine(): index(0), bit(0) {};
+
+	static constexpr BoardLine of(LineDirection dir, int x, int y)
+	{
+		return (dir == lineRow) ? BoardLine(y, x) :
+			(dir == lineColumn) ? BoardLine(BOARD_HEIGHT + x, y) :
+			(dir == lineDiagonal) ? BoardLine(offset(dir) + x - y + BOARD_HEIGHT - 1, y) :
+			BoardLine(offset(dir) + x + y, y);
+	}
+
+	static constexpr int offset(LineDirection dir)
+	{
+		return (dir == lineRow) ? 0 :
+			(dir == lineColumn) ? BOARD_HEIGHT :
+			(dir == lineDiagonal) ? BOARD_HEIGHT + BOARD_WIDTH :
+			BOARD_HEIGHT + BOARD_WIDTH + DIAGONAL_COUNT;
+	}
+
+	static constexpr LineDirection direction(int index)
+	{
+		return (index < offset(lineColumn)) ? lineRow :
+			(index < offset(lineDiagonal)) ? lineColumn :
+			(index < offset(lineAntiDiagonal)) ? lineDiagonal :
+			lineAntiDiagonal;
+	}
+
+	static constexpr int dirX(LineDirection dir) { return (dir == lineColumn) ? 0 : (dir == lineAntiDiagonal) ? -1 : 1; }
+	static constexpr int dirY(LineDirection dir) { return (dir == lineRow) ? 0 : 1; }
+
+	constexpr LineDirection direction() const { return direction(index); }
+	constexpr int key() const { return index - offset(direction()); }
+
+	constexpr int x() const
+	{
+		return (direction() == lineRow) ? bit :
+			(direction() == lineColumn) ? key() :
+			(direction() == lineDiagonal) ? bit + key() - (BOARD_HEIGHT - 1) :
+			key() - bit;
+	}
+
+	constexpr int y() const
+	{
+		return (direction() == lineRow) ? key() : bit;
+	}
+
+	constexpr int first() const
+	{
+		return (direction() == lineDiagonal) ? CLAMP(BOARD_HEIGHT - 1 - key(), 0, BOARD_HEIGHT - 1) :
+			(direction() == lineAntiDiagonal) ? CLAMP(key() - BOARD_WIDTH + 1, 0, BOARD_HEIGHT - 1) :
+			0;
+	}
+
+	constexpr int last() const
+	{
+		return (direction() == lineRow) ? BOARD_WIDTH - 1 :
+			(direction() == lineColumn) ? BOARD_HEIGHT - 1 :
+			(direction() == lineDiagonal) ? CLAMP(BOARD_WIDTH + BOARD_HEIGHT - 2 - key(), 0, BOARD_HEIGHT - 1) :
+			CLAMP(key(), 0, BOARD_HEIGHT - 1);
+	}
+
+	// Bits of the line that lie on the board
+	constexpr LineBits mask() const
+	{
+		return ((LineBits(2) << last()) - 1) & ~((LineBits(1) << first()) - 1);
+	}
+
+	constexpr BoardLine at(int _bit) const { return BoardLine(index, _bit); }
+};
+
+/*
+** The geometry of every line worked out once: the bits on the board, the
+** first and last of them, and the cell of bit 0 and the step between two
+** bits as indexes in a row-major 19x19 array. The bits off the board act
+** as a border of blocked cells around each line, so scans walk cell
+** indexes without checking coordinates.
+*/
+struct LineTable
+{
+	LineBits	masks[LINE_COUNT];
+	int			first[LINE_COUNT];
+	int			last[LINE_COUNT];
+	int			origin[LINE_COUNT];
+	int			step[LINE_COUNT];
+
+	static const LineTable& get()
+	{
+		static const LineTable table;
+		return table;
+	}
+
+	int cell(int index, int bit) const { return origin[index] + bit * step[index]; }
+
+private:
+	LineTable()
+	{
+		for (int index = 0; index < LINE_COUNT; index++)
+		{
+			BoardLine line(index, 0);
+			LineDirection dir = line.direction();
+
+			masks[index] = line.mask();
+			first[index] = line.first();
+			last[index] = line.last();
+			origin[index] = line.y() * BOARD_WIDTH + line.x();
+			step[index] = BoardLine::dirY(dir) * BOARD_WIDTH + BoardLine::dirX(dir);
+		}
+	}
+};
+
+static_assert(LINE_COUNT <= 128, "a LineSet holds 128 lines");
+
+// A set of line indexes, walked in index order
+struct LineSet
+{
+	uint64_t	words[2];
+
+	LineSet(): words() {}
+
+	bool	empty() const { return !(words[0] | words[1]); }
+	void	set(int index, bool value)
+	{
+		uint64_t bit = uint64_t(1) << (index & 63);
+
+		words[index >> 6] = value ? (words[index >> 6] | bit) : (words[index >> 6] & ~bit);
+	}
+
+	// Calls f(index) for each line of the set
+	template <typename F>
+	void	forEach(F f) const
+	{
+		for (int word = 0; word < 2; word++)
+			for (uint64_t rest = words[word]; rest; rest &= rest - 1)
+				f(word * 64 + __builtin_ctzll(rest));
+	}
+};
@@ -0,0 +1,12 @@
+#pragma once
+
+/*
+** What a client of libgomoku needs: the rules of the game, the board and
+** the search. Nothing in here depends on the window or its options, and
+** the search internals stay behind Game's forward declarations.
+*/
+#include "Rules.hpp"
+#include "BoardPos.hpp"
+#include "PlayerColor.hpp"
+#include "Board.hpp"
+#include "Game.hpp"
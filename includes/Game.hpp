@@ -3,55 +3,109 @@
 #include <ctime>
 #include <atomic>
 #include <chrono>
+#include <functional>
+#include <future>
 #include <random>
+#include <thread>
+#include <vector>
 #include "PlayerColor.hpp"
 #include "BoardPos.hpp"
 #include "Constants.hpp"
 #include "Board.hpp"
-#include "ThreadData.hpp"
-#include "Options.hpp"
+#include "Rules.hpp"
 
-template <typename Data, typename Value> class ThreadPool;
+// The search internals stay in Game.cpp, clients only see their names
+class ThreadPool;
+class TranspositionTable;
+class SearchControl;
+struct ThreadData;
+struct SplitPoint;
+
+// Where a search stands after each completed depth
+struct SearchProgress
+{
+	int			depth;
+	Score		score;
+	BoardPos	best;
+	double		time;
+};
 
 class Game
 {
 public:
-	Game(const Options& _options);
+	Game(const Rules& rules, const SearchSettings& settings = SearchSettings());
 	~Game();
 	bool play(BoardPos pos);
 	bool play();
 
 	PlayerColor getTurn() const;
-	bool isPlayerNext() const;
 	bool hasPosChanged(BoardPos pos) const;
 	bool isOverdue() const;
+	void stopSearch();
 	double getTimeDiff() const;
 	double getTimeTaken() const;
+	int getDepthReached() const;
 	Score getCurrentScore() const;
 
 	Board *getState();
+	// BoardPos::boardEnd() when the side to move has no move left
 	BoardPos getNextMove();
 
+	typedef std::function<void(const SearchProgress&)> ProgressCallback;
+	// getNextMove on a thread of its own, stopSearch ends it early
+	std::future<BoardPos> startSearch(ProgressCallback onProgress = ProgressCallback());
+
+	// Searches the answer to the expected move while the other player thinks
+	void startPondering();
+	void stopPondering();
+
 private:
 
-	typedef ThreadPool<ThreadData, MoveScore> Pool;
+	typedef ThreadPool Pool;
+	struct SplitJob;
+	struct ThreadLocal;
 
 	std::chrono::high_resolution_clock::time_point _start;
+	SearchControl* _control;
 	std::mt19937 _randomDevice;
 
-	Options	_options;
+	Rules	_rules;
 	double	_timeLimit;
+	// What the running search may spend, unbounded when pondering
+	double	_searchLimit;
 	double	_timeTaken;
 	int		_constDepth;
 	int		_depth;
+	int		_completedDepth;
 
 	Board*		_state;
 	Board*		_previousState;
 	PlayerColor	_turn;
+	// The line the last search expects from _state on, first move first
+	std::vector<BoardPos>	_pv;
+	// Called from the search thread, see startSearch
+	ProgressCallback		_onProgress;
+
+	std::thread			_ponderThread;
+	BoardPos			_ponderMove;
+	BoardPos			_ponderReply;
+	std::atomic<bool>	_ponderDone;
+	bool				_ponderHit;
 
-	Score negamax(Board& node, int depth, Score alpha, Score beta, PlayerColor player);
-	MoveScore negamax_thread(ThreadData data);
+	Score negamax(Board& node, int depth, Score alpha, Score beta, PlayerColor player, const SplitPoint* split);
+	Score quiesce(Board& node, int depth, Score alpha, Score beta, PlayerColor player, int& nodes);
+	void search_split(SplitPoint& split, const Board& node, const MoveScore* moves, int count, int depth, PlayerColor player);
+	MoveScore negamax_thread(const ThreadData& data, bool pv);
+	void negamax_root(Board *node, PlayerColor player, const std::vector<MoveScore>& moves, Score alpha, Score beta, std::vector<MoveScore>& result);
 	BoardPos start_negamax(Board *node, PlayerColor player);
+	void store_pv(const Board& node, PlayerColor player, BoardPos best);
+	void prepare_search();
+	void arm_search();
+	BoardPos run_search();
+	ThreadLocal& threadLocal();
 
 	Pool *_pool;
+	TranspositionTable *_table;
+	std::vector<ThreadLocal*> _locals;
+	std::vector<ThreadData> *_threadData;
 };
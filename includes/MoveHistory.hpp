@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include "Constants.hpp"
+#include "BoardPos.hpp"
+#include "PlayerColor.hpp"
+#include "Board.hpp"
+
+/*
+** What one search thread learnt about move ordering: the last two moves
+** that caused a cutoff at each ply (killers), and a history score per
+** colour and cell, raised by moves that caused a cutoff and lowered by the
+** moves tried before them.
+*/
+struct MoveHistory
+{
+	static const int maxPly = 32;
+	static const int maxHistory = 1 << 14;
+	// A full history is worth this much priority
+	static const int historyWeight = 64;
+
+	BoardPos	killers[maxPly][2];
+	int			history[2][BOARD_HEIGHT][BOARD_WIDTH];
+
+	MoveHistory() { clear(); }
+
+	void	clear();
+	void	age();
+	void	onCutoff(int ply, PlayerColor player, int depth, const BoardPos* tried, int triedCount, BoardPos move);
+
+private:
+	static int	side(PlayerColor player) { return player == whitePlayer; }
+	void		addHistory(PlayerColor player, BoardPos pos, int bonus);
+};
+
+inline void MoveHistory::clear()
+{
+	std::fill(&history[0][0][0], &history[0][0][0] + 2 * BOARD_HEIGHT * BOARD_WIDTH, 0);
+	std::fill(&killers[0][0], &killers[0][0] + maxPly * 2, BoardPos::boardEnd());
+}
+
+// Between two moves of the game: killers belong to the old plies, the history fades
+inline void MoveHistory::age()
+{
+	for (int* value = &history[0][0][0]; value != &history[0][0][0] + 2 * BOARD_HEIGHT * BOARD_WIDTH; value++)
+		*value /= 2;
+	std::fill(&killers[0][0], &killers[0][0] + maxPly * 2, BoardPos::boardEnd());
+}
+
+inline void MoveHistory::onCutoff(int ply, PlayerColor player, int depth, const BoardPos* tried, int triedCount, BoardPos move)
+{
+	BoardPos* killer = killers[std::min(ply, maxPly - 1)];
+	int bonus = std::min(depth * depth, int(maxHistory));
+
+	if (killer[0] != move)
+	{
+		killer[1] = killer[0];
+		killer[0] = move;
+	}
+	addHistory(player, move, bonus);
+	for (int i = 0; i < triedCount; i++)
+		if (tried[i] != move)
+			addHistory(player, tried[i], -bonus);
+}
+
+// Moves the value towards +-maxHistory, slower as it gets closer, so it never leaves the range
+inline void MoveHistory::addHistory(PlayerColor player, BoardPos pos, int bonus)
+{
+	int& value = history[side(player)][pos.y][pos.x];
+
+	value += bonus - value * std::abs(bonus) / maxHistory;
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include "Arena.hpp"
+#include "Board.hpp"
+#include "MoveHistory.hpp"
+#include "ThreatSolver.hpp"
+#include "TranspositionTable.hpp"
+
+/*
+** Hands out the moves of a node one at a time, doing only the work the
+** moves asked so far need: the table move, fives to make or to block, the
+** killers, then the other candidates by priority and history. The first of
+** those are picked by a selection pass, the rest sorted once if a cutoff
+** still has not come. Move lists live in the thread's arena, in the scope
+** of the caller.
+*/
+class MovePicker
+{
+public:
+	MovePicker(const Board& board, PlayerColor player, const MoveHistory& history, Arena& arena, int ply, const TableHit& hit, int width);
+
+	bool	next(BoardPos& move);
+	// The last move came from the plain candidates with less than this score
+	bool	isQuiet(int threshold) const { return _stage == stageRest && _rest[_index - 1].score < threshold; }
+
+private:
+	enum Stage
+	{
+		stageTable,
+		stageThreats,
+		stageKillers,
+		stageGenerate,
+		stageRest,
+		stageCentre,
+		stageDone,
+	};
+
+	// Picks made by selection before the remaining candidates get sorted
+	static const int selectionPicks = 3;
+
+	const Board&		_board;
+	PlayerColor			_player;
+	const MoveHistory&	_history;
+	Arena&				_arena;
+	int					_ply;
+	TableHit			_hit;
+	int					_width;
+	Stage				_stage;
+	int					_given;
+	int					_index;
+	LineBits			_seen[BOARD_HEIGHT];
+	CellList*			_threats;
+	MoveScore*			_rest;
+	int					_restCount;
+
+	bool	accept(BoardPos pos, bool candidate);
+	void	generate();
+};
+
+inline MovePicker::MovePicker(const Board& board, PlayerColor player, const MoveHistory& history, Arena& arena, int ply, const TableHit& hit, int width):
+		_board(board),
+		_player(player),
+		_history(history),
+		_arena(arena),
+		_ply(std::min(ply, MoveHistory::maxPly - 1)),
+		_hit(hit),
+		_width(width),
+		_stage(stageTable),
+		_given(0),
+		_index(0),
+		_seen(),
+		_threats(),
+		_rest(),
+		_restCount(0)
+{
+}
+
+// Marks the move given, unless it was already or cannot be played here
+inline bool MovePicker::accept(BoardPos pos, bool candidate)
+{
+	if ((_seen[pos.y] >> pos.x) & 1)
+		return false;
+	if (_board.getCase(pos) != BoardSquare::empty)
+		return false;
+	int priority = _board.getPriority(pos);
+	if (priority < 0 || (candidate && priority == 0))
+		return false;
+	_seen[pos.y] |= LineBits(1) << pos.x;
+	_given++;
+	return true;
+}
+
+inline void MovePicker::generate()
+{
+	const BoardData& data = *_board.getData();
+	const int (&history)[BOARD_HEIGHT][BOARD_WIDTH] = _history.history[_player == whitePlayer];
+
+	_rest = _arena.allocate<MoveScore>(BOARD_HEIGHT * BOARD_WIDTH);
+	for (int y = 0; y < BOARD_HEIGHT; y++)
+	{
+		LineBits free = ~(data[black - 1][y] | data[white - 1][y] | _seen[y]) & ((LineBits(1) << BOARD_WIDTH) - 1);
+
+		for (; free; free &= free - 1)
+		{
+			int x = __builtin_ctz(free);
+			int priority = _board.getPriority(x, y);
+
+			if (priority > 0)
+				_rest[_restCount++] = MoveScore(priority + history[y][x] * MoveHistory::historyWeight / MoveHistory::maxHistory,
+						BoardPos(x, y));
+		}
+	}
+}
+
+inline bool MovePicker::next(BoardPos& move)
+{
+	while (_given < _width)
+	{
+		switch (_stage)
+		{
+		case stageTable:
+			_stage = stageThreats;
+			if (_hit.hasMove && accept(_hit.move, false))
+			{
+				move = _hit.move;
+				return true;
+			}
+			break;
+
+		case stageThreats:
+			if (!_threats)
+			{
+				PlayerColor enemy = -_player;
+
+				_threats = new (_arena.allocate<CellList>(1)) CellList();
+				ThreatSolver::fiveMoves(_board, _player, *_threats);
+				ThreatSolver::fiveMoves(_board, enemy, *_threats);
+			}
+			while (_index < _threats->count)
+			{
+				BoardPos pos = _threats->cells[_index++];
+				if (accept(pos, true))
+				{
+					move = pos;
+					return true;
+				}
+			}
+			_stage = stageKillers;
+			_index = 0;
+			break;
+
+		case stageKillers:
+			while (_index < 2)
+			{
+				BoardPos pos = _history.killers[_ply][_index++];
+				if (pos != BoardPos::boardEnd() && accept(pos, true))
+				{
+					move = pos;
+					return true;
+				}
+			}
+			_stage = stageGenerate;
+			break;
+
+		case stageGenerate:
+			generate();
+			_stage = stageRest;
+			_index = 0;
+			break;
+
+		case stageRest:
+			if (_index == selectionPicks && _index < _restCount)
+				std::partial_sort(_rest + _index, _rest + std::min(_restCount, _index + _width - _given), _rest + _restCount,
+						[](const MoveScore& a, const MoveScore& b) { return a.score > b.score; });
+			if (_index < selectionPicks)
+			{
+				MoveScore* best = std::max_element(_rest + _index, _rest + _restCount,
+						[](const MoveScore& a, const MoveScore& b) { return a.score < b.score; });
+				if (best != _rest + _restCount)
+					std::swap(*best, _rest[_index]);
+			}
+			if (_index < _restCount)
+			{
+				move = _rest[_index++].pos;
+				_seen[move.y] |= LineBits(1) << move.x;
+				_given++;
+				return true;
+			}
+			_stage = stageCentre;
+			break;
+
+		// Nothing near any stone: the board is empty
+		case stageCentre:
+			_stage = stageDone;
+			if (!_given && accept(BoardPos(BOARD_WIDTH / 2, BOARD_HEIGHT / 2), false))
+			{
+				move = BoardPos(BOARD_WIDTH / 2, BOARD_HEIGHT / 2);
+				return true;
+			}
+			break;
+
+		case stageDone:
+			return false;
+		}
+	}
+	return false;
+}
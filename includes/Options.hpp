@@ -1,15 +1,33 @@
 #pragma once
 
-class Options
+#include "PlayerColor.hpp"
+#include "Rules.hpp"
+
+class Options : public Rules
 {
 public:
 	bool showTips = false;
 	bool showPriority = false;
-	bool doubleThree = true;
-	bool capture = true;
-	bool captureWin = true;
 	bool brainDead = true;
 	bool isBlackAI = true;
 	bool isWhiteAI = true;
 	bool slowMode = false;
+	int tableSize = 64;
+	bool hugePages = false;
+
+	// Whether the move of `turn` is left to a human
+	bool isPlayerNext(PlayerColor turn) const
+	{
+		return (!isBlackAI && turn == blackPlayer) || (!isWhiteAI && turn == whitePlayer);
+	}
+
+	SearchSettings getSearchSettings() const
+	{
+		SearchSettings settings;
+
+		settings.timeLimit = slowMode ? 10 : 0.5;
+		settings.tableSize = tableSize;
+		settings.hugePages = hugePages;
+		return settings;
+	}
 };
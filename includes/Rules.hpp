@@ -0,0 +1,17 @@
+#pragma once
+
+// The variant being played, all the engine knows of the game's options
+struct Rules
+{
+	bool doubleThree = true;
+	bool capture = true;
+	bool captureWin = true;
+};
+
+// What a search may spend
+struct SearchSettings
+{
+	double	timeLimit = 0.5;
+	int		tableSize = 64;
+	bool	hugePages = false;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/*
+** When a search has to stop. A timer thread raises the flag at the
+** deadline and anyone else may raise it sooner with stop(), so search
+** threads only ever pay for a relaxed load of the flag.
+*/
+class SearchControl
+{
+public:
+	SearchControl(): _stopped(false), _finished(false) {}
+	~SearchControl() { finish(); }
+
+	// Clears the flag and raises it again in `seconds`
+	void	start(double seconds);
+	// Clears the flag, only stop() raises it
+	void	start();
+	// Gives up on the deadline once the search is over
+	void	finish();
+	void	stop() { _stopped.store(true, std::memory_order_relaxed); }
+	bool	isStopped() const { return _stopped.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<bool>		_stopped;
+	bool					_finished;
+	std::mutex				_mutex;
+	std::condition_variable	_wakeUp;
+	std::thread				_timer;
+
+	SearchControl(const SearchControl&);
+	SearchControl& operator=(const SearchControl&);
+};
+
+inline void SearchControl::start(double seconds)
+{
+	finish();
+	_stopped.store(false, std::memory_order_relaxed);
+	_finished = false;
+
+	auto deadline = std::chrono::steady_clock::now()
+			+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+
+	_timer = std::thread([this, deadline]()
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		if (!_wakeUp.wait_until(lock, deadline, [this]() { return _finished; }))
+			stop();
+	});
+}
+
+inline void SearchControl::start()
+{
+	finish();
+	_stopped.store(false, std::memory_order_relaxed);
+}
+
+inline void SearchControl::finish()
+{
+	if (!_timer.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_finished = true;
+	}
+	_wakeUp.notify_one();
+	_timer.join();
+}
@@ -1,22 +1,87 @@
 #pragma once
 
 #include <atomic>
+#include <mutex>
 #include "Board.hpp"
 #include "PlayerColor.hpp"
 
 class Game;
 
+// Raises value to score if it is lower, whatever the other threads write meanwhile
+inline void atomicMax(std::atomic<Score>& value, Score score)
+{
+	Score current = value.load(std::memory_order_relaxed);
+
+	while (current < score && !value.compare_exchange_weak(current, score, std::memory_order_acq_rel))
+		;
+}
+
 struct ThreadData
 {
 	ThreadData(){};
-	ThreadData(ChildBoard _node, std::atomic<Score>* _alpha, PlayerColor _player):
+	ThreadData(const Board* _node, BoardPos _move, std::atomic<Score>* _alpha, Score _beta, PlayerColor _player):
 			node(_node),
+			move(_move),
 			alpha(_alpha),
+			beta(_beta),
 			player(_player)
 	{}
 
 	~ThreadData(){};
-	ChildBoard node;
+	const Board* node;
+	BoardPos move;
 	std::atomic<Score>* alpha;
+	Score beta;
 	PlayerColor player;
 };
+
+/*
+** Node whose younger brothers are searched in parallel once the eldest is
+** done. Helpers share its alpha and best move, and give up as soon as it
+** or any split point above it is cut off.
+*/
+struct SplitPoint
+{
+	SplitPoint(const SplitPoint* _parent, Score _alpha, Score _beta, Score _bestScore, BoardPos _bestMove):
+			parent(_parent),
+			alpha(_alpha),
+			beta(_beta),
+			cutoff(false),
+			bestScore(_bestScore),
+			bestMove(_bestMove)
+	{}
+
+	const SplitPoint*	parent;
+	std::atomic<Score>	alpha;
+	const Score			beta;
+	std::atomic<bool>	cutoff;
+	std::mutex			lock;
+	Score				bestScore;
+	BoardPos			bestMove;
+
+	bool isCutoff() const
+	{
+		for (const SplitPoint* split = this; split; split = split->parent)
+			if (split->cutoff.load(std::memory_order_relaxed))
+				return true;
+		return false;
+	}
+
+	void update(Score score, BoardPos move)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestMove = move;
+		}
+		atomicMax(alpha, score);
+		if (score > beta)
+			cutoff.store(true, std::memory_order_relaxed);
+	}
+
+private:
+	SplitPoint(const SplitPoint&);
+	SplitPoint& operator=(const SplitPoint&);
+};
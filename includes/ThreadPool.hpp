@@ -3,132 +3,382 @@
 #include <thread>
 #include <vector>
 #include <atomic>
-#include <iostream>
+#include <mutex>
 #include <condition_variable>
 
+class ThreadPool;
+class TaskGroup;
 
-template <typename Data, typename Value>
-class ThreadPool
+// A unit of work owned by whoever spawns it, the pool only passes pointers around
+struct Job
+{
+	TaskGroup* group;
+	Job* next;
+
+	Job(): group(), next() {}
+	virtual ~Job() {}
+	virtual void execute() = 0;
+};
+
+/*
+** Chase-Lev deque: its owner pushes and pops at the bottom while other
+** threads steal from the top, all without locks.
+*/
+class WorkDeque
 {
-	typedef std::function<Value(Data)> Call;
-	typedef std::unique_lock<std::mutex> Lock;
+public:
+	static const long capacity = 1024;
 
+	WorkDeque();
+
+	bool	push(Job* job);
+	Job*	pop();
+	Job*	steal();
+
+private:
+	std::atomic<long>				_top;
+	char							_padding[64];
+	std::atomic<long>				_bottom;
+	std::atomic<Job*>				_buffer[capacity];
+};
+
+/*
+** Jobs spawned by a task group can be run by any worker; wait() runs or
+** steals other jobs until the group's own are done, so a job may spawn
+** and wait for jobs of its own.
+*/
+class TaskGroup
+{
 public:
-	ThreadPool(const ThreadPool& cpy);
+	explicit TaskGroup(ThreadPool& pool): _pool(pool), _pending(0) {}
+	~TaskGroup() { wait(); }
 
+	void	spawn(Job& job);
+	void	wait();
+
+private:
+	friend class ThreadPool;
+
+	ThreadPool&			_pool;
+	std::atomic<int>	_pending;
+
+	TaskGroup(const TaskGroup&);
+	TaskGroup& operator=(const TaskGroup&);
+};
+
+/*
+** Work-stealing pool: every worker owns a deque, jobs submitted from other
+** threads go through a shared queue. Idle workers park on an event count
+** so a job pushed while they go to sleep always wakes them.
+*/
+class ThreadPool
+{
+public:
 	ThreadPool(int threadCount);
 	~ThreadPool();
 
-	std::vector<Value> run(Call call, const std::vector<Data> &data);
+	template <typename Body>
+	void parallelFor(size_t begin, size_t end, const Body& body);
+
+	size_t	size() const { return _threads.size(); }
+	// Index of the calling worker, -1 for threads outside the pool
+	int		workerIndex() const { return selfIndex(); }
 
 private:
+	friend class TaskGroup;
+
+	template <typename Body>
+	struct RangeJob : public Job
+	{
+		ThreadPool*	pool;
+		const Body*	body;
+		size_t		begin;
+		size_t		end;
 
-	void waitForData();
-	void display(std::string str);
+		RangeJob(ThreadPool* _pool, const Body* _body, size_t _begin, size_t _end):
+				pool(_pool), body(_body), begin(_begin), end(_end) {}
+		void execute() { pool->runRange(*body, begin, end); }
+	};
 
-	bool isKill;
+	std::vector<std::thread>	_threads;
+	std::vector<WorkDeque*>		_deques;
 
-	Call _call;
+	// Jobs from outside the pool, chained through Job::next so queuing never allocates
+	std::mutex					_injectedMutex;
+	Job*						_injectedHead;
+	Job*						_injectedTail;
+	std::atomic<int>			_injectedCount;
 
-	std::mutex _startedCounterMutex;
-	int _startedCounter;
-	std::mutex _finishedCounterMutex;
-	int _finishedCounter;
+	std::atomic<bool>			_stop;
+	std::atomic<unsigned>		_epoch;
+	std::atomic<int>			_sleepers;
+	std::mutex					_sleepMutex;
+	std::condition_variable		_wakeUp;
 
-	std::mutex _condMutexFinished;
-	std::mutex _condMutexStarted;
-	std::condition_variable _finished;
-	std::condition_variable _started;
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
 
-	std::mutex _displayMutex;
+	void	workerLoop(int index);
+	void	submit(Job* job);
+	Job*	findJob();
+	void	execute(Job* job);
+	void	wake();
+	void	park(unsigned epoch);
 
-	std::vector<Data> _data;
-	std::vector<Value> _values;
-	std::vector<std::thread*> _threads;
+	template <typename Body>
+	void	runRange(const Body& body, size_t begin, size_t end);
+
+	int		selfIndex() const { return currentPool() == this ? currentIndex() : -1; }
+
+	static const ThreadPool*&	currentPool() { static thread_local const ThreadPool* pool = nullptr; return pool; }
+	static int&					currentIndex() { static thread_local int index = -1; return index; }
 };
 
-template <typename Data, typename Value>
-ThreadPool<Data, Value>::ThreadPool(int threadCount)
+inline WorkDeque::WorkDeque(): _top(0), _bottom(0)
+{
+	for (long i = 0; i < capacity; i++)
+		_buffer[i].store(nullptr, std::memory_order_relaxed);
+}
+
+inline bool WorkDeque::push(Job* job)
 {
-	isKill = false;
+	long bottom = _bottom.load(std::memory_order_relaxed);
+	long top = _top.load(std::memory_order_acquire);
 
-	_threads.resize(threadCount);
-	for (int i = 0; i < threadCount; i++)
+	if (bottom - top >= capacity)
+		return false;
+	_buffer[bottom & (capacity - 1)].store(job, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	_bottom.store(bottom + 1, std::memory_order_relaxed);
+	return true;
+}
+
+inline Job* WorkDeque::pop()
+{
+	long bottom = _bottom.load(std::memory_order_relaxed) - 1;
+	_bottom.store(bottom, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long top = _top.load(std::memory_order_relaxed);
+
+	if (top > bottom)
+	{
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+	Job* job = _buffer[bottom & (capacity - 1)].load(std::memory_order_relaxed);
+	if (top == bottom)
 	{
-		auto functor = std::bind(&ThreadPool::waitForData, this);
-		_threads[i] = new std::thread(functor);
+		// Last job: race the thieves for it
+		if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		_bottom.store(bottom + 1, std::memory_order_relaxed);
 	}
+	return job;
+}
+
+inline Job* WorkDeque::steal()
+{
+	long top = _top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	long bottom = _bottom.load(std::memory_order_acquire);
 
+	if (top >= bottom)
+		return nullptr;
+	Job* job = _buffer[top & (capacity - 1)].load(std::memory_order_relaxed);
+	if (!_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
 }
 
-template <typename Data, typename Value>
-ThreadPool<Data, Value>::~ThreadPool()
+inline void TaskGroup::spawn(Job& job)
 {
-	isKill = true;
+	job.group = this;
+	_pending.fetch_add(1, std::memory_order_relaxed);
+	_pool.submit(&job);
+}
 
-	_started.notify_all();
+inline void TaskGroup::wait()
+{
+	while (_pending.load(std::memory_order_acquire) > 0)
+	{
+		Job* job = _pool.findJob();
 
-	for (size_t i = 0; i < _threads.size(); i++)
+		if (!job)
+		{
+			_pool._sleepers.fetch_add(1);
+			unsigned epoch = _pool._epoch.load();
+			if (_pending.load(std::memory_order_acquire) > 0 && !(job = _pool.findJob()))
+				_pool.park(epoch);
+			_pool._sleepers.fetch_sub(1);
+		}
+		if (job)
+			_pool.execute(job);
+	}
+}
+
+inline ThreadPool::ThreadPool(int threadCount):
+		_injectedHead(nullptr),
+		_injectedTail(nullptr),
+		_injectedCount(0),
+		_stop(false),
+		_epoch(0),
+		_sleepers(0)
+{
+	for (int i = 0; i < threadCount; i++)
+		_deques.push_back(new WorkDeque());
+	for (int i = 0; i < threadCount; i++)
+		_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+inline ThreadPool::~ThreadPool()
+{
+	_stop.store(true);
+	wake();
 	{
-		_threads[i]->join();
-		delete _threads[i];
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wakeUp.notify_all();
 	}
+	for (size_t i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+	for (size_t i = 0; i < _deques.size(); i++)
+		delete _deques[i];
 }
 
-template <typename Data, typename Value>
-void ThreadPool<Data, Value>::waitForData()
+inline void ThreadPool::workerLoop(int index)
 {
-	while (1)
+	currentPool() = this;
+	currentIndex() = index;
+
+	while (!_stop.load(std::memory_order_acquire))
 	{
+		Job* job = findJob();
+
+		for (int spin = 0; !job && spin < 64; spin++)
 		{
-			Lock lock(_condMutexStarted);
-			_started.wait(lock);
+			std::this_thread::yield();
+			job = findJob();
 		}
-		if (isKill)
-			return;
+		if (!job)
 		{
-			Lock lock(_finishedCounterMutex);
-			_finishedCounter++;
+			_sleepers.fetch_add(1);
+			unsigned epoch = _epoch.load();
+			if (!(job = findJob()))
+				park(epoch);
+			_sleepers.fetch_sub(1);
 		}
+		if (job)
+			execute(job);
+	}
+}
+
+inline void ThreadPool::submit(Job* job)
+{
+	int self = selfIndex();
+
+	if (self >= 0)
+	{
+		if (!_deques[self]->push(job))
+		{
+			execute(job);
+			return;
+		}
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(_injectedMutex);
+		job->next = nullptr;
+		if (_injectedTail)
+			_injectedTail->next = job;
+		else
+			_injectedHead = job;
+		_injectedTail = job;
+		_injectedCount.fetch_add(1);
+	}
+	wake();
+}
+
+inline Job* ThreadPool::findJob()
+{
+	int self = selfIndex();
+	Job* job;
 
-		while (1)
+	if (self >= 0 && (job = _deques[self]->pop()))
+		return job;
+	if (_injectedCount.load() > 0)
+	{
+		std::lock_guard<std::mutex> lock(_injectedMutex);
+		if ((job = _injectedHead))
 		{
-			int index;
-			{
-				Lock lock(_startedCounterMutex);
-				index = _startedCounter;
-				_startedCounter++;
-			}
-
-			if (static_cast<size_t>(index) < _data.size())
-				_values[index] = _call(_data[index]);
-			else
-			{
-				{
-					Lock lock(_finishedCounterMutex);
-					_finishedCounter--;
-					if (_finishedCounter <= 0)
-						_finished.notify_one();
-				}
-				break;
-			}
+			_injectedHead = job->next;
+			if (!_injectedHead)
+				_injectedTail = nullptr;
+			_injectedCount.fetch_sub(1);
+			return job;
 		}
 	}
+	size_t count = _deques.size();
+	size_t first = (self >= 0) ? self + 1 : 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t victim = (first + i) % count;
+		if (static_cast<int>(victim) != self && (job = _deques[victim]->steal()))
+			return job;
+	}
+	return nullptr;
 }
 
-template <typename Data, typename Value>
-std::vector<Value> ThreadPool<Data, Value>::run(Call call, const std::vector<Data> &data)
+inline void ThreadPool::execute(Job* job)
 {
-	_call = call;
-	_data = data;
+	TaskGroup* group = job->group;
 
-	_values.resize(_data.size());
-	_startedCounter = 0;
-	_finishedCounter = 0;
-	_started.notify_all();
+	job->execute();
+	// The group and the job may be gone as soon as the count reaches zero
+	if (group->_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		wake();
+}
+
+inline void ThreadPool::wake()
+{
+	_epoch.fetch_add(1);
+	if (_sleepers.load() > 0)
 	{
-		Lock lock(_condMutexFinished);
-		_finished.wait(lock);
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_wakeUp.notify_all();
 	}
-	return (_values);
-}
\ No newline at end of file
+}
+
+inline void ThreadPool::park(unsigned epoch)
+{
+	std::unique_lock<std::mutex> lock(_sleepMutex);
+
+	while (_epoch.load() == epoch && !_stop.load())
+		_wakeUp.wait(lock);
+}
+
+/*
+** Splits [begin, end) in halves, spawning the upper one and running the
+** lower one, so the first indices start first and idle workers steal the
+** largest pieces left.
+*/
+template <typename Body>
+void ThreadPool::runRange(const Body& body, size_t begin, size_t end)
+{
+	if (end - begin > 1)
+	{
+		size_t middle = begin + (end - begin) / 2;
+		RangeJob<Body> upper(this, &body, middle, end);
+		TaskGroup group(*this);
+
+		group.spawn(upper);
+		runRange(body, begin, middle);
+		group.wait();
+	}
+	else if (begin < end)
+		body(begin);
+}
+
+template <typename Body>
+void ThreadPool::parallelFor(size_t begin, size_t end, const Body& body)
+{
+	runRange(body, begin, end);
+}
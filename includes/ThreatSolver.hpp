@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include "Board.hpp"
+#include "BoardPos.hpp"
+#include "PlayerColor.hpp"
+#include "Rules.hpp"
+#include "SearchControl.hpp"
+
+// Cells collected once each, in the order they were found
+struct CellList
+{
+	BoardPos	cells[BOARD_HEIGHT * BOARD_WIDTH];
+	LineBits	seen[BOARD_HEIGHT];
+	int			count;
+
+	CellList(): seen(), count(0) {}
+
+	void add(int x, int y)
+	{
+		if (!((seen[y] >> x) & 1))
+		{
+			seen[y] |= LineBits(1) << x;
+			cells[count++] = BoardPos(x, y);
+		}
+	}
+};
+
+/*
+** Threat-space search: the attacker only plays moves the defender has to
+** answer, fours (VCF) or fours and free threes (VCT), and the defender only
+** the moves that answer them: blocks, captures and fours of their own.
+** Narrow enough to read forced wins far deeper than negamax, it gives up
+** (no win found) once it has visited its node budget.
+*/
+class ThreatSolver
+{
+public:
+	// Gives up as soon as `control` is stopped, when there is one
+	ThreatSolver(const Rules& rules, size_t nodeLimit, const SearchControl* control = nullptr);
+
+	bool	solveVCF(Board& board, PlayerColor attacker, int depth, BoardPos& move);
+	bool	solveVCT(Board& board, PlayerColor attacker, int depth, BoardPos& move);
+	size_t	getNodes() const { return _nodes; }
+
+	static void	fiveMoves(const Board& board, PlayerColor player, CellList& list);
+	static void	fourMoves(const Board& board, PlayerColor player, CellList& list);
+	static void	threeMoves(const Board& board, PlayerColor player, CellList& list);
+	static void	threeDefences(const Board& board, PlayerColor player, CellList& list);
+	static void	captureMoves(const Board& board, PlayerColor player, CellList& list);
+
+private:
+	const Rules&			_rules;
+	size_t					_nodeLimit;
+	size_t					_nodes;
+	const SearchControl*	_control;
+
+	bool	solve(Board& board, PlayerColor attacker, int depth, bool threes, BoardPos& move);
+	bool	attack(Board& board, PlayerColor attacker, int depth, bool threes, BoardPos* move);
+	bool	defend(Board& board, PlayerColor attacker, int depth, bool threes);
+	bool	isForbidden(const Board& board, BoardPos pos, PlayerColor player) const;
+	bool	isExhausted();
+};
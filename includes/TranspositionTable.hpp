@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "Constants.hpp"
+#include "BoardPos.hpp"
+
+enum BoundType
+{
+	boundNone = 0,
+	boundExact = 1,
+	boundLower = 2,
+	boundUpper = 3,
+};
+
+struct TableHit
+{
+	Score		score;
+	int			depth;
+	BoundType	bound;
+	bool		hasMove;
+	BoardPos	move;
+
+	TableHit():score(),depth(),bound(boundNone),hasMove(false),move(){};
+};
+
+/*
+** Fixed-size table of search results shared by every search thread.
+** Entries are read and written without locks: the key is stored xored with
+** the payload, so a reader drops entries torn by a concurrent write.
+*/
+class TranspositionTable
+{
+public:
+	TranspositionTable(size_t megabytes, bool hugePages);
+	~TranspositionTable();
+
+	bool	probe(uint64_t key, TableHit& hit) const;
+	void	store(uint64_t key, int depth, BoundType bound, Score score, bool hasMove, BoardPos move);
+
+	void	newSearch() { _generation++; }
+	void	clear();
+
+private:
+	struct Entry
+	{
+		std::atomic<uint64_t>	check;
+		std::atomic<uint64_t>	score;
+		std::atomic<uint64_t>	data;
+	};
+
+	Entry*		_entries;
+	size_t		_mask;
+	size_t		_bytes;
+	uint8_t		_generation;
+
+	TranspositionTable(const TranspositionTable&);
+	TranspositionTable& operator=(const TranspositionTable&);
+
+	// data: depth on bits 0-7, bound 8-9, x 10-14, y 15-19, hasMove 20, generation 24-31
+	static uint64_t	pack(int depth, BoundType bound, bool hasMove, BoardPos move, uint8_t generation)
+	{
+		return static_cast<uint64_t>(depth & 0xFF)
+				| static_cast<uint64_t>(bound) << 8
+				| static_cast<uint64_t>(move.x & 0x1F) << 10
+				| static_cast<uint64_t>(move.y & 0x1F) << 15
+				| static_cast<uint64_t>(hasMove) << 20
+				| static_cast<uint64_t>(generation) << 24;
+	}
+};
+
+inline bool TranspositionTable::probe(uint64_t key, TableHit& hit) const
+{
+	const Entry& entry = _entries[key & _mask];
+	uint64_t check = entry.check.load(std::memory_order_relaxed);
+	uint64_t score = entry.score.load(std::memory_order_relaxed);
+	uint64_t data = entry.data.load(std::memory_order_relaxed);
+
+	if ((check ^ score ^ data) != key || !data)
+		return false;
+	hit.score = static_cast<Score>(score);
+	hit.depth = data & 0xFF;
+	hit.bound = static_cast<BoundType>((data >> 8) & 3);
+	hit.move = BoardPos((data >> 10) & 0x1F, (data >> 15) & 0x1F);
+	hit.hasMove = (data >> 20) & 1;
+	return true;
+}
+
+inline void TranspositionTable::store(uint64_t key, int depth, BoundType bound, Score score, bool hasMove, BoardPos move)
+{
+	Entry& entry = _entries[key & _mask];
+	uint64_t oldCheck = entry.check.load(std::memory_order_relaxed);
+	uint64_t oldScore = entry.score.load(std::memory_order_relaxed);
+	uint64_t oldData = entry.data.load(std::memory_order_relaxed);
+
+	// Keep deeper results of the current search for other positions
+	if ((oldCheck ^ oldScore ^ oldData) != key
+		&& ((oldData >> 24) & 0xFF) == _generation
+		&& static_cast<int>(oldData & 0xFF) > depth)
+		return;
+
+	uint64_t data = pack(depth, bound, hasMove, move, _generation);
+	uint64_t bits = static_cast<uint64_t>(score);
+
+	entry.score.store(bits, std::memory_order_relaxed);
+	entry.data.store(data, std::memory_order_relaxed);
+	entry.check.store(key ^ bits ^ data, std::memory_order_relaxed);
+}
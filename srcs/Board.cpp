@@ -1,62 +1,359 @@
 #include "Board.hpp"
 #include <random>
 #include <algorithm>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define BOARD_AVX2
+#endif
+
+/*
+** Priority a stone gives to the four cells following it: each empty cell
+** before the first enemy stone or board edge gets the current value plus
+** a quarter of the final one. `capture` is set when the ray starts with
+** two enemy stones followed by an empty cell.
+*/
+struct RayPriority
+{
+	short cells[4];
+	bool capture;
+};
 
-inline Score Board::fillScore()
+/*
+** Value of the four cells following a stone, given as bit masks nearest
+** cell first: empty cells score the current value, allied stones multiply
+** it by 8 and the first enemy stone or board edge ends the ray.
+*/
+struct RayTable
 {
-	Score score = 0;
-	for (int y = 0; y < BOARD_HEIGHT; y++)
+	int forward[16][16];
+	int backward[16][16];
+	RayPriority priorityForward[16][16];
+	RayPriority priorityBackward[16][16];
+
+	static const RayTable& get()
 	{
-		for (int x = 0; x < BOARD_WIDTH; x++)
+		static const RayTable table;
+		return table;
+	}
+
+	int scoreForward(LineBits allied, LineBits blocked, int bit) const
+	{
+		return forward[(allied >> (bit + 1)) & 15][(blocked >> (bit + 1)) & 15];
+	}
+
+	int scoreBackward(LineBits allied, LineBits blocked, int bit) const
+	{
+		return backward[((allied << 4) >> bit) & 15][(((blocked << 4) | 15) >> bit) & 15];
+	}
+
+	const RayPriority& prioritizeForward(LineBits allied, LineBits blocked, int bit) const
+	{
+		return priorityForward[(allied >> (bit + 1)) & 15][(blocked >> (bit + 1)) & 15];
+	}
+
+	const RayPriority& prioritizeBackward(LineBits allied, LineBits blocked, int bit) const
+	{
+		return priorityBackward[((allied << 4) >> bit) & 15][(((blocked << 4) | 15) >> bit) & 15];
+	}
+
+private:
+	RayTable()
+	{
+		for (int allied = 0; allied < 16; allied++)
 		{
-			BoardSquare color = _data[y][x];
-			if (color != BoardSquare::empty)
+			for (int blocked = 0; blocked < 16; blocked++)
 			{
-				Score squareScore = 0;
-				for (int dirX = -1; dirX <= 1; dirX++)
+				RayPriority& priority = priorityForward[allied][blocked];
+				int value = 1;
+				int score = 0;
+				int emptyCount = 0;
+				int i;
+
+				for (i = 0; i < 4 && !(blocked & (1 << i)); i++)
 				{
-					for (int dirY = -1; dirY <= 1; dirY++)
+					priority.cells[i] = 0;
+					if (allied & (1 << i))
+						value <<= 3;
+					else
 					{
-						if (dirX || dirY)
-						{
-							const int maxX = CLAMP(x + 5 * dirX, -1, BOARD_WIDTH);
-							const int maxY = CLAMP(y + 5 * dirY, -1, BOARD_HEIGHT);
-
-							int value = 1;
-							int emptyCount = 0;
-
-							int _x = x + dirX;
-							int _y = y + dirY;
-
-							while ((dirX == 0 || _x != maxX) && (dirY == 0 || _y != maxY))
-							{
-								BoardSquare square = _data[_y][_x];
-								if (square == empty)
-								{
-									squareScore += value;
-									emptyCount++;
-								}
-								else if (square == color)
-									value <<= 3;
-								else
-									break;
-								_x += dirX, _y+= dirY;
-							}
-							value >>= 2;
-							squareScore += value * emptyCount;
-						}
+						priority.cells[i] = value;
+						score += value;
+						emptyCount++;
 					}
 				}
-				score += (color == BoardSquare::white) ? squareScore : -squareScore;
+				value >>= 2;
+				forward[allied][blocked] = score + value * emptyCount;
+
+				while (i < 4)
+					priority.cells[i++] = 0;
+				for (i = 0; i < 4; i++)
+					if (priority.cells[i])
+						priority.cells[i] += value;
+				priority.capture = (blocked & 3) == 3 && !((blocked | allied) & 4);
+			}
+		}
+		for (int allied = 0; allied < 16; allied++)
+		{
+			for (int blocked = 0; blocked < 16; blocked++)
+			{
+				backward[allied][blocked] = forward[reverse(allied)][reverse(blocked)];
+				priorityBackward[allied][blocked] = priorityForward[reverse(allied)][reverse(blocked)];
 			}
 		}
 	}
+
+	static int reverse(int bits)
+	{
+		return ((bits & 1) << 3) | ((bits & 2) << 1) | ((bits & 4) >> 1) | ((bits & 8) >> 3);
+	}
+};
+
+/*
+** Class of the nine cells window centred on a cell, the window read as a
+** base 3 number (0 empty, 1 allied, 2 enemy or off the board) so one
+** lookup answers what would otherwise be a scan of every five or six cells
+** window going through the centre. The centre counts as an allied stone,
+** played already or about to be.
+*/
+struct PatternTable
+{
+	unsigned char classes[19683];
+	short ternary[512];
+
+	static const PatternTable& get()
+	{
+		static const PatternTable table;
+		return table;
+	}
+
+	int classify(LineBits allied, LineBits blocked, int bit) const
+	{
+		return classes[ternary[((allied << 4) >> bit) & 0x1FF] + 2 * ternary[(((blocked << 4) | 15) >> bit) & 0x1FF]];
+	}
+
+private:
+	PatternTable()
+	{
+		for (int bits = 0; bits < 512; bits++)
+		{
+			ternary[bits] = 0;
+			for (int i = 8; i >= 0; i--)
+				ternary[bits] = ternary[bits] * 3 + ((bits >> i) & 1);
+		}
+		for (int allied = 0; allied < 512; allied++)
+			for (int blocked = 0; blocked < 512; blocked++)
+				if (!(allied & blocked))
+					classes[ternary[allied] + 2 * ternary[blocked]] = pattern(allied, blocked);
+	}
+
+	// The centre is cell 4, every five cells window of the nine goes through it
+	static unsigned char pattern(int allied, int blocked)
+	{
+		unsigned char result = 0;
+		int stones = allied | 0x10;
+
+		for (int first = 0; first <= 4; first++)
+		{
+			int window = 0x1F << first;
+			int ends = 0x11 << first;
+			int count = __builtin_popcount(stones & window);
+
+			if (blocked & window)
+				continue;
+			if (count == 5)
+				result |= patternFive;
+			// The missing stone at an end of the window or between two others
+			else if (count == 4)
+				result |= (ends & ~stones) ? patternFour : patternBrokenFour;
+		}
+		// The six cells windows with the centre among their four inner cells
+		for (int first = 0; first < 4; first++)
+		{
+			int window = 0x3F << first;
+			int ends = 0x21 << first;
+
+			if (!(blocked & window) && !(stones & ends) && __builtin_popcount(stones & window) == 3)
+				result |= patternFreeThree;
+		}
+		return result;
+	}
+};
+
+// Random keys of every stone for Zobrist hashing, the same on every run
+struct ZobristTable
+{
+	uint64_t stones[2][BOARD_HEIGHT * BOARD_WIDTH];
+
+	static const ZobristTable& get()
+	{
+		static const ZobristTable table;
+		return table;
+	}
+
+	// Keys of the rest of the state, drawn from the state itself
+	static uint64_t mix(uint64_t value)
+	{
+		value += 0x9E3779B97F4A7C15ULL;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+		return value ^ (value >> 31);
+	}
+
+private:
+	ZobristTable()
+	{
+		std::mt19937_64 generator(0x476F6D6F6B75ULL);
+
+		for (int color = 0; color < 2; color++)
+			for (int cell = 0; cell < BOARD_HEIGHT * BOARD_WIDTH; cell++)
+				stones[color][cell] = generator();
+	}
+};
+
+uint64_t Board::getHash() const
+{
+	uint64_t state = static_cast<uint64_t>(_capturedBlacks)
+			| static_cast<uint64_t>(_capturedWhites) << 16
+			| static_cast<uint64_t>(_turn + 1) << 32
+			| static_cast<uint64_t>(_victoryFlag + 1) << 34;
+
+	return _hash ^ ZobristTable::mix(state);
+}
+
+/*
+** Score of the rays of the given stones of a line, white counting as
+** positive and black as negative.
+*/
+Score Board::lineScore(int index, LineBits stones) const
+{
+	const RayTable& rays = RayTable::get();
+	LineBits outside = ~LineTable::get().masks[index];
+	Score score = 0;
+
+	for (int color = 0; color < 2; color++)
+	{
+		LineBits allied = _data[color][index];
+		LineBits blocked = _data[!color][index] | outside;
+		Score colorScore = 0;
+
+		for (LineBits rest = allied & stones; rest; rest &= rest - 1)
+		{
+			int bit = __builtin_ctz(rest);
+			colorScore += rays.scoreForward(allied, blocked, bit) + rays.scoreBackward(allied, blocked, bit);
+		}
+		score += (color == white - 1) ? colorScore : -colorScore;
+	}
+	return score;
+}
+
+#ifdef BOARD_AVX2
+static_assert(LINE_COUNT % 8 == 0, "the AVX2 kernel scores lines eight at a time");
+
+static bool hasAvx2()
+{
+	static const bool supported = __builtin_cpu_supports("avx2");
+	return supported;
+}
+
+/*
+** lineScore over every stone of the board, eight lines per vector: for
+** each bit holding a stone in one of the lines, the rays of all eight are
+** gathered from the RayTable and kept where the line has a stone there.
+*/
+__attribute__((target("avx2")))
+static Score scoreLinesAvx2(const BoardData& data)
+{
+	const RayTable& rays = RayTable::get();
+	const LineTable& lines = LineTable::get();
+	const __m256i fifteen = _mm256_set1_epi32(15);
+	const __m256i one = _mm256_set1_epi32(1);
+	Score score = 0;
+
+	for (int index = 0; index < LINE_COUNT; index += 8)
+	{
+		__m256i inside = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&lines.masks[index]));
+		__m256i outside = _mm256_xor_si256(inside, _mm256_set1_epi32(-1));
+
+		for (int color = 0; color < 2; color++)
+		{
+			__m256i allied = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&data[color][index]));
+			__m256i blocked = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&data[!color][index])), outside);
+			// Shifted so the cells behind bit 0 read as blocked, as in RayTable::scoreBackward
+			__m256i alliedHigh = _mm256_slli_epi32(allied, 4);
+			__m256i blockedHigh = _mm256_or_si256(_mm256_slli_epi32(blocked, 4), fifteen);
+			__m256i total = _mm256_setzero_si256();
+			LineBits present = 0;
+			int lanes[8];
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), allied);
+			for (int i = 0; i < 8; i++)
+				present |= lanes[i];
+			for (; present; present &= present - 1)
+			{
+				int bit = __builtin_ctz(present);
+				__m128i shift = _mm_cvtsi32_si128(bit);
+				__m128i next = _mm_cvtsi32_si128(bit + 1);
+				__m256i stone = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_srl_epi32(allied, shift), one), one);
+				__m256i forward = _mm256_or_si256(
+						_mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(allied, next), fifteen), 4),
+						_mm256_and_si256(_mm256_srl_epi32(blocked, next), fifteen));
+				__m256i backward = _mm256_or_si256(
+						_mm256_slli_epi32(_mm256_and_si256(_mm256_srl_epi32(alliedHigh, shift), fifteen), 4),
+						_mm256_and_si256(_mm256_srl_epi32(blockedHigh, shift), fifteen));
+
+				total = _mm256_add_epi32(total, _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+						&rays.forward[0][0], forward, stone, 4));
+				total = _mm256_add_epi32(total, _mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+						&rays.backward[0][0], backward, stone, 4));
+			}
+
+			Score colorScore = 0;
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+			for (int i = 0; i < 8; i++)
+				colorScore += lanes[i];
+			score += (color == white - 1) ? colorScore : -colorScore;
+		}
+	}
+	return score;
+}
+#endif
+
+Score Board::scalarBoardScore() const
+{
+	Score score = 0;
+
+	for (int index = 0; index < LINE_COUNT; index++)
+		score += lineScore(index, ~LineBits(0));
 	return score;
 }
 
-inline Score Board::getScore(bool considerCapture)
+// The score of every line, vectorised when the CPU has AVX2
+Score Board::boardScore() const
 {
-	Score score = fillScore();
+#ifdef BOARD_AVX2
+	if (hasAvx2())
+		return scoreLinesAvx2(_data);
+#endif
+	return scalarBoardScore();
+}
+
+/*
+** Scores the whole board from scratch, setCase keeps the cached score up
+** to date afterwards.
+*/
+Score Board::fillScore()
+{
+	_cache.score = boardScore();
+	return _cache.score;
+}
+
+Score Board::getScore(bool considerCapture) const
+{
+	if (!_cache.valid)
+		refreshCache();
+
+	Score score = _cache.score;
 
 	if (considerCapture)
 	{
@@ -70,56 +367,196 @@ inline Score Board::getScore(bool considerCapture)
 	return score;
 }
 
-inline bool Board::isAlignedStoneDir(int x, int y, int dirX, int dirY, BoardSquare color, int size) const
+void Board::setCase(int x, int y, BoardSquare square)
+{
+	const ZobristTable& keys = ZobristTable::get();
+	BoardSquare previous = getCase(x, y);
+
+	if (previous != empty)
+		_hash ^= keys.stones[previous - 1][y * BOARD_WIDTH + x];
+	if (square != empty)
+		_hash ^= keys.stones[square - 1][y * BOARD_WIDTH + x];
+
+	for (int dir = 0; dir < LINE_DIRECTIONS; dir++)
+	{
+		BoardLine line = BoardLine::of(static_cast<LineDirection>(dir), x, y);
+		LineBits bit = LineBits(1) << line.bit;
+		// Only the stones up to four cells away have (x, y) in their rays
+		LineBits around = (LineBits(0x1FF) << line.bit) >> 4;
+
+		if (_cache.valid)
+		{
+			_cache.score -= lineScore(line.index, around);
+			spreadPriority(line.index, around, -1);
+		}
+		_data[black - 1][line.index] &= ~bit;
+		_data[white - 1][line.index] &= ~bit;
+		if (square != empty)
+			_data[square - 1][line.index] |= bit;
+		trackLine(line.index);
+		if (_cache.valid)
+		{
+			_cache.score += lineScore(line.index, around);
+			spreadPriority(line.index, around, 1);
+			if (_cache.doubleThree)
+				markThrees(line.index, around);
+		}
+	}
+}
+
+/*
+** Bit n of the result is set when the `size` stones starting at bit n are
+** all set in `stones`.
+*/
+static LineBits alignedRuns(LineBits stones, int size)
+{
+	LineBits runs = stones;
+	for (int i = 1; i < size; i++)
+		runs &= stones >> i;
+	return runs;
+}
+
+bool Board::isFive(int x, int y) const
 {
-	int ix = x + (size - 1) * -dirX;
-	int iy = y + (size - 1) * -dirY;
-	int mx = x + size * dirX;
-	int my = y + size * dirY;
+	BoardSquare color = getCase(x, y);
 
-	while (ix < 0 || iy < 0 || ix >= BOARD_WIDTH || iy >= BOARD_HEIGHT)
-		ix += dirX, iy += dirY;
-	while (mx < -1 || my < -1 || mx > BOARD_WIDTH || my > BOARD_HEIGHT)
-		mx -= dirX, my -= dirY;
+	if (color == empty)
+		return false;
 
-	int count = 0;
+	const PatternTable& patterns = PatternTable::get();
+	const LineTable& lines = LineTable::get();
+	const int side = color - 1;
 
-	while ((dirX == 0 || ix != mx) && (dirY == 0 || iy != my))
+	for (int dir = 0; dir < LINE_DIRECTIONS; dir++)
 	{
-		if (_data[iy][ix] != color)
-			count = 0;
-		else if (++count == size)
+		BoardLine line = BoardLine::of(static_cast<LineDirection>(dir), x, y);
+		LineBits blocked = _data[!side][line.index] | ~lines.masks[line.index];
+
+		if (patterns.classify(_data[side][line.index], blocked, line.bit) & patternFive)
 			return true;
-		ix += dirX, iy += dirY;
 	}
 	return false;
 }
 
-inline bool Board::isAlignedStonePos(int x, int y, int size) const
+LineBits Board::getCaptureCells(int index, PlayerColor player) const
 {
-	BoardSquare c = _data[y][x];
-	if (c == empty) return false;
+	LineBits allied = _data[player == whitePlayer][index];
+	LineBits enemy = _data[player != whitePlayer][index];
+	LineBits free = LineTable::get().masks[index] & ~(allied | enemy);
 
-	if (isAlignedStoneDir(x, y, 1, 0, c, size)) return true;
-	if (isAlignedStoneDir(x, y, 1, 1, c, size)) return true;
-	if (isAlignedStoneDir(x, y, 0, 1, c, size)) return true;
-	if (isAlignedStoneDir(x, y, -1, 1, c, size)) return true;
-	return false;
+	return (free & (enemy >> 1) & (enemy >> 2) & (allied >> 3))
+			| (free & (enemy << 1) & (enemy << 2) & (allied << 3));
 }
 
-inline bool Board::isAlignedStone(int size) const
+// Only the lines through a changed cell can gain or lose a capture or a five
+// Empty cells of a line where a stone of the player makes one of the pattern classes along it
+LineBits Board::getPatternCells(int index, PlayerColor player, int classes) const
 {
-	for (int y = 0 ; y < BOARD_HEIGHT; ++y)
-		for (int x = 0 ; x < BOARD_WIDTH; ++x)
-			if (_data[y][x] != empty)
-			if (isAlignedStonePos(x, y, size))
-				return true;
+	const PatternTable& patterns = PatternTable::get();
+	const int color = (player == whitePlayer);
+	LineBits allied = _data[color][index];
+	LineBits blocked = _data[!color][index] | ~LineTable::get().masks[index];
+	LineBits near = 0;
+	LineBits cells = 0;
+
+	// Nothing is made more than four cells away from the player's stones
+	for (int distance = 1; distance <= 4; distance++)
+		near |= (allied << distance) | (allied >> distance);
+	for (LineBits rest = near & ~allied & ~blocked; rest; rest &= rest - 1)
+	{
+		int bit = __builtin_ctz(rest);
+
+		if (patterns.classify(allied, blocked, bit) & classes)
+			cells |= LineBits(1) << bit;
+	}
+	return cells;
+}
+
+void Board::trackLine(int index)
+{
+	for (int color = 0; color < 2; color++)
+	{
+		PlayerColor player = color ? whitePlayer : blackPlayer;
+
+		_captureLines[color].set(index, getCaptureCells(index, player) != 0);
+		_fiveLines[color].set(index, alignedRuns(_data[color][index], 5) != 0);
+	}
+}
+
+// Whether the enemy can take a pair out of one of the owner's fives
+bool Board::isFiveBreakable(PlayerColor owner) const
+{
+	const LineTable& lines = LineTable::get();
+	const int own = (owner == whitePlayer);
+	LineBits fives[BOARD_HEIGHT] = {};
+	bool breakable = false;
+
+	_fiveLines[own].forEach([&](int index)
+	{
+		LineBits runs = alignedRuns(_data[own][index], 5);
+		LineBits stones = runs | (runs << 1) | (runs << 2) | (runs << 3) | (runs << 4);
+
+		for (; stones; stones &= stones - 1)
+		{
+			int cell = lines.cell(index, __builtin_ctz(stones));
+			fives[cell / BOARD_WIDTH] |= LineBits(1) << (cell % BOARD_WIDTH);
+		}
+	});
+	_captureLines[!own].forEach([&](int index)
+	{
+		LineBits capturer = _data[!own][index];
+		LineBits victim = _data[own][index];
+		LineBits free = lines.masks[index] & ~(capturer | victim);
+		LineBits forward = free & (victim >> 1) & (victim >> 2) & (capturer >> 3);
+		LineBits backward = free & (victim << 1) & (victim << 2) & (capturer << 3);
+
+		for (LineBits taken = (forward << 1) | (forward << 2) | (backward >> 1) | (backward >> 2); taken; taken &= taken - 1)
+		{
+			int cell = lines.cell(index, __builtin_ctz(taken));
+			if ((fives[cell / BOARD_WIDTH] >> (cell % BOARD_WIDTH)) & 1)
+				breakable = true;
+		}
+	});
+	return breakable;
+}
+
+// The most pairs one move of the player takes, a move taking along several lines at once
+int Board::mostPairsTaken(PlayerColor player) const
+{
+	const LineTable& lines = LineTable::get();
+	const int own = (player == whitePlayer);
+	unsigned char pairs[BOARD_HEIGHT * BOARD_WIDTH] = {};
+	int most = 0;
+
+	_captureLines[own].forEach([&](int index)
+	{
+		LineBits capturer = _data[own][index];
+		LineBits victim = _data[!own][index];
+		LineBits free = lines.masks[index] & ~(capturer | victim);
+		LineBits forward = free & (victim >> 1) & (victim >> 2) & (capturer >> 3);
+		LineBits backward = free & (victim << 1) & (victim << 2) & (capturer << 3);
+
+		for (LineBits cells = forward; cells; cells &= cells - 1)
+			most = std::max(most, int(++pairs[lines.cell(index, __builtin_ctz(cells))]));
+		for (LineBits cells = backward; cells; cells &= cells - 1)
+			most = std::max(most, int(++pairs[lines.cell(index, __builtin_ctz(cells))]));
+	});
+	return most;
+}
+
+bool Board::isAlignedStone(int size) const
+{
+	if (size == 5)
+		return !_fiveLines[0].empty() || !_fiveLines[1].empty();
+	for (int index = 0; index < LINE_COUNT; ++index)
+		if (alignedRuns(_data[black - 1][index], size) || alignedRuns(_data[white - 1][index], size))
+			return true;
 	return false;
 }
 
-inline VictoryState  Board::calculateVictory(BoardPos pos, const Options& options)
+VictoryState Board::calculateVictory(BoardPos pos, const Rules& rules)
 {
-	if (options.captureWin)
+	if (rules.captureWin)
 	{
 		if (_capturedWhites >= captureVictoryPoints)
 			return VictoryState(blackPlayer, VictoryType::captured);
@@ -128,21 +565,25 @@ inline VictoryState  Board::calculateVictory(BoardPos pos, const Options& option
 	}
 	if (_victoryFlag == -_turn)
 	{
-		if (isAlignedStonePos(_alignmentPos.x, _alignmentPos.y, 5))
+		if (isFive(_alignmentPos.x, _alignmentPos.y))
 			return VictoryState(_victoryFlag, aligned);
 		else
 			_victoryFlag = nullPlayer;
 	}
 
-	if (isAlignedStonePos(pos.x, pos.y, 5))
+	if (isFive(pos.x, pos.y))
 	{
-		if (options.capture)
-		{
-			_victoryFlag = _turn;
-			_alignmentPos = pos;
-		}
-		else
+		PlayerColor enemy = -_turn;
+		int enemyCaptures = (enemy == whitePlayer) ? _capturedBlacks : _capturedWhites;
+		// The enemy could still win by taking the last pairs
+		bool captureEscape = rules.captureWin && !getCaptureLines(enemy).empty()
+				&& enemyCaptures + 2 * mostPairsTaken(enemy) >= captureVictoryPoints;
+
+		// A five the enemy cannot break wins now rather than after their move
+		if (!rules.capture || (!captureEscape && !isFiveBreakable(_turn)))
 			return VictoryState(_turn, aligned);
+		_victoryFlag = _turn;
+		_alignmentPos = pos;
 	}
 
 	if (_turnNum - _capturedBlacks - _capturedWhites == BOARD_HEIGHT * BOARD_WIDTH)
@@ -152,22 +593,30 @@ inline VictoryState  Board::calculateVictory(BoardPos pos, const Options& option
 	return  VictoryState(novictory);
 }
 
-inline VictoryState Board::getVictory()
+VictoryState Board::getVictory()
 {
 	return (_victoryState);
 }
 
-inline size_t Board::getChildren(MoveScore* buffer, size_t count)
+constexpr int forbiddenZone = 4;
+constexpr int middleX = (BOARD_WIDTH / 2);
+constexpr int middleY = (BOARD_HEIGHT / 2);
+
+size_t Board::getChildren(MoveScore* buffer, size_t count)
 {
+	if (!_cache.valid)
+		refreshCache();
+
 	MoveScore* bufferEnd = buffer;
 
 	for (int y = 0; y < BOARD_HEIGHT; y++)
 	{
+		LineBits free = ~(_data[black - 1][y] | _data[white - 1][y]);
 		for (int x = 0; x < BOARD_WIDTH; x++)
 		{
-			if (_data[y][x] == empty)
+			if (((free >> x) & 1) && !isTaboo(x, y))
 			{
-				int score = _priority[y][x];
+				int score = _cache.priority[y][x];
 				if (score > 0)
 				{
 					*bufferEnd = MoveScore(score, BoardPos(x, y));
@@ -177,6 +626,12 @@ inline size_t Board::getChildren(MoveScore* buffer, size_t count)
 		}
 	}
 
+	if (bufferEnd == buffer && getCase(middleX, middleY) == empty)
+	{
+		*bufferEnd = MoveScore(1, BoardPos(middleX, middleY));
+		bufferEnd++;
+	}
+
 	struct Sorter
 	{
 		Sorter(){};
@@ -196,252 +651,292 @@ inline size_t Board::getChildren(MoveScore* buffer, size_t count)
 }
 
 
-inline bool Board::playCaptureDir(int x, int y, int dirX, int dirY, BoardSquare good) {
-
-	BoardSquare bad = (good == BoardSquare::white ? BoardSquare::black : BoardSquare::white);
+bool Board::playCaptureDir(BoardLine line, int step, BoardSquare good) const
+{
+	int end = line.bit + 3 * step;
 
-	if (x + 3*dirX < 0 || x + 3*dirX >= BOARD_WIDTH
-		|| y + 3*dirY < 0 || y + 3*dirY >= BOARD_HEIGHT)
+	if (end < 0)
 		return (false);
-	return (_data[y][x] == good
-			&& _data[y + dirY*1][x + dirX*1] == bad
-			&& _data[y + dirY*2][x + dirX*2] == bad
-			&& _data[y + dirY*3][x + dirX*3] == good);
-}
 
-inline int Board::playCapture(int x, int y) {
-	BoardSquare c = _data[y][x];
+	LineBits allied = _data[good - 1][line.index];
+	LineBits enemy = _data[(good == white ? black : white) - 1][line.index];
 
-	int capCount = 0;
-	for (int dirX = -1 ; dirX <= 1; ++dirX)
-		for (int dirY = -1 ; dirY <= 1; ++dirY)
-			if (dirX || dirY) {
-				if (playCaptureDir(x, y, dirX, dirY, c)) {
-					_data[y + dirY * 1][x + dirX * 1] = BoardSquare::empty;
-					_data[y + dirY * 2][x + dirX * 2] = BoardSquare::empty;
-					++capCount;
-				}
-			}
-	return capCount;
+	return (((allied >> line.bit) & 1)
+			&& ((enemy >> (line.bit + step)) & 1)
+			&& ((enemy >> (line.bit + 2 * step)) & 1)
+			&& ((allied >> end) & 1));
 }
 
-inline bool Board::checkFreeThree(int x, int y, int dirX, int dirY, BoardSquare enemy)
+void Board::removePair(BoardLine line, int step, MoveUndo* undo)
 {
-	int ix = x + 4 * -dirX;
-	int iy = y + 4 * -dirY;
-	int mx = x + 5 * dirX;
-	int my = y + 5 * dirY;
+	const LineTable& lines = LineTable::get();
+	int first = lines.cell(line.index, line.bit + step);
+	int second = lines.cell(line.index, line.bit + 2 * step);
 
-	while (ix < 0 || iy < 0 || ix >= BOARD_WIDTH || iy >= BOARD_HEIGHT)
-		ix += dirX, iy += dirY;
-	while (mx < -1 || my < -1 || mx > BOARD_WIDTH || my > BOARD_HEIGHT)
-		mx -= dirX, my -= dirY;
-
-	BoardSquare buffer[6];
-	int bufferIndex = 0;
-	bool didLoop = false;
-
-	while ((!dirX || ix != mx) && (!dirY || iy != my))
+	setCase(first % BOARD_WIDTH, first / BOARD_WIDTH, BoardSquare::empty);
+	setCase(second % BOARD_WIDTH, second / BOARD_WIDTH, BoardSquare::empty);
+	if (undo)
 	{
-		BoardSquare tmp = _data[iy][ix];
-		buffer[bufferIndex] = tmp;
-
-		++bufferIndex;
-
-		if (bufferIndex == 6)
-		{
-			bufferIndex = 0;
-			didLoop = true;
-		}
-
-		if (didLoop)
-		{
-			if (tmp == empty && buffer[bufferIndex] == empty)
-			{
-				int emptyCount = 0;
-				bool foundEnemy = false;
-				for (BoardSquare square:buffer)
-				{
-					if (square == enemy)
-					{
-						foundEnemy = true;
-						break;
-					}
-					if (square == BoardSquare::empty)
-						emptyCount++;
-				}
-				if (!foundEnemy && emptyCount == 4)
-					return true;
-			}
-		}
-		ix += dirX, iy += dirY;
+		undo->captured[undo->captureCount++] = BoardPos(first % BOARD_WIDTH, first / BOARD_WIDTH);
+		undo->captured[undo->captureCount++] = BoardPos(second % BOARD_WIDTH, second / BOARD_WIDTH);
 	}
-	return false;
 }
 
-constexpr int forbiddenZone = 4;
-constexpr int middleX = (BOARD_WIDTH / 2);
-constexpr int middleY = (BOARD_HEIGHT / 2);
+int Board::playCapture(int x, int y, MoveUndo* undo) {
+	BoardSquare c = getCase(x, y);
 
-inline void Board::fillTaboo(bool doubleThree, PlayerColor player)
-{
-	BoardSquare enemy = (player == blackPlayer)? white : black;
-	if (doubleThree)
+	int capCount = 0;
+	for (int dir = 0; dir < LINE_DIRECTIONS; ++dir)
 	{
-		for (int y = 0; y < BOARD_HEIGHT; y++)
+		BoardLine line = BoardLine::of(static_cast<LineDirection>(dir), x, y);
+		for (int step = -1; step <= 1; step += 2)
 		{
-			for (int x = 0; x < BOARD_WIDTH; x++)
-			{
-				if (_data[y][x] == BoardSquare::empty)
-				{
-					int count = 0;
-					if (checkFreeThree(x, y, 1, 0, enemy)) count++;
-					if (checkFreeThree(x, y, 1, 1, enemy)) count++;
-					if (count >= 2) {_priority[y][x] = -1; continue;}
-					if (checkFreeThree(x, y, 0, 1, enemy)) count++;
-					if (count >= 2) {_priority[y][x] = -1; continue;}
-					if (checkFreeThree(x, y, -1, 1, enemy)) count++;
-					if (count >= 2) {_priority[y][x] = -1; continue;}
-				}
+			if (playCaptureDir(line, step, c)) {
+				removePair(line, step, undo);
+				++capCount;
 			}
 		}
 	}
+	return capCount;
 }
 
+/*
+** A free three appears when a stone on (x, y) would leave three allied
+** stones in a six cells window with empty ends and no enemy stone, (x, y)
+** being one of the four inner cells.
+*/
+bool Board::checkFreeThree(int x, int y, LineDirection dir, BoardSquare enemy) const
+{
+	BoardLine line = BoardLine::of(dir, x, y);
+	LineBits foes = _data[enemy - 1][line.index] | ~LineTable::get().masks[line.index];
+	LineBits allies = _data[(enemy == white ? black : white) - 1][line.index];
+
+	return PatternTable::get().classify(allies, foes, line.bit) & patternFreeThree;
+}
 
-inline void Board::fillPriorityDir(int x, int y, int dirX, int dirY, BoardSquare color)
+// Free threes are only tracked while the rule is on
+void Board::setDoubleThree(bool doubleThree)
 {
-	const int maxX = CLAMP(x + 5 * dirX, -1, BOARD_WIDTH);
-	const int maxY = CLAMP(y + 5 * dirY, -1, BOARD_HEIGHT);
+	if (doubleThree && !_cache.doubleThree)
+		_cache.valid = false;
+	_cache.doubleThree = doubleThree;
+}
 
-	int value = 1;
-	int count = 0;
+// The side to move may not play a double free three when the rule is on
+bool Board::isTaboo(int x, int y) const
+{
+	if (!_cache.doubleThree)
+		return false;
+	if (!_cache.valid)
+		refreshCache();
 
-	x += dirX, y+= dirY;
-	while ((!dirX || x != maxX) && (!dirY || y != maxY))
-	{
-		BoardSquare square = _data[y][x];
-		if (square == color)
-		{
-			value <<= 3;
-		}
-		else if (square == empty)
-		{
-			if (_priority[y][x] >= 0)
-				_priority[y][x] += value;
-		}
-		else
-		{
-			count++;
-			break;
-		}
-		x += dirX, y+= dirY;
-		count++;
-	}
-	value >>= 2;
-	while (count > 0)
-	{
-		count--;
-		x -= dirX, y -= dirY;
+	unsigned char threes = _cache.threes[_turn == whitePlayer][y][x];
 
-		BoardSquare square = _data[y][x];
-		if (square == empty && _priority[y][x] >= 0)
-			_priority[y][x] += value;
-	}
-};
+	return (threes & (threes - 1)) && getCase(x, y) == empty;
+}
 
-inline void Board::fillCapturePriorityDir(int x, int y, int dirX, int dirY, BoardSquare color)
+/*
+** Works out again, for the given empty cells of a line, whether a stone of
+** either colour would make a free three along it. A stone only changes
+** the cells up to four away on its lines, so setCase marks those alone,
+** the cell it empties included.
+*/
+void Board::markThrees(int index, LineBits cells) const
 {
-	int endX = x + dirX * 3;
-	int endY = y + dirY * 3;
+	const PatternTable& patterns = PatternTable::get();
+	const LineTable& lines = LineTable::get();
+	const unsigned char flag = 1 << BoardLine::direction(index);
+	LineBits outside = ~lines.masks[index];
+	LineBits free = cells & lines.masks[index] & ~(_data[0][index] | _data[1][index]);
 
-	if (endX >= 0 && endX < BOARD_WIDTH && endY >= 0 && endY < BOARD_HEIGHT)
-	if (_data[y + dirY * 1][x + dirX * 1] == color &&
-		_data[y + dirY * 2][x + dirX * 2] == color &&
-		_data[endY][endX] == empty)
+	for (int color = 0; color < 2; color++)
 	{
-		_priority[endY][endX] += capturePriority;
+		unsigned char* threes = &_cache.threes[color][0][0];
+		LineBits allied = _data[color][index];
+		LineBits blocked = _data[!color][index] | outside;
+
+		for (LineBits rest = free; rest; rest &= rest - 1)
+		{
+			int bit = __builtin_ctz(rest);
+
+			if (patterns.classify(allied, blocked, bit) & patternFreeThree)
+				threes[lines.cell(index, bit)] |= flag;
+			else
+				threes[lines.cell(index, bit)] &= ~flag;
+		}
 	}
-};
+}
 
-inline void Board::fillPriority(const Options& options)
+/*
+** Adds (sign 1) or removes (sign -1) the priority the given stones of a
+** line give to the empty cells of that line.
+*/
+void Board::spreadPriority(int index, LineBits stones, int sign) const
 {
-	for (int y = 0; y < BOARD_HEIGHT; y++)
+	const RayTable& rays = RayTable::get();
+	const LineTable& lines = LineTable::get();
+	const int step = lines.step[index];
+	const int origin = lines.origin[index];
+	short* priority = &_cache.priority[0][0];
+	LineBits outside = ~lines.masks[index];
+
+	for (int color = 0; color < 2; color++)
 	{
-		for (int x = 0; x < BOARD_WIDTH; x++)
+		LineBits allied = _data[color][index];
+		LineBits blocked = _data[!color][index] | outside;
+
+		for (LineBits rest = allied & stones; rest; rest &= rest - 1)
 		{
-			BoardSquare color = _data[y][x];
-			if (color != BoardSquare::empty)
+			int bit = __builtin_ctz(rest);
+			const RayPriority& forward = rays.prioritizeForward(allied, blocked, bit);
+			const RayPriority& backward = rays.prioritizeBackward(allied, blocked, bit);
+
+			for (int i = 0; i < 4; i++)
 			{
-				BoardSquare enemyColor = (color == white) ? black : white;
-
-				fillPriorityDir(x, y, -1, -1, color);
-				fillPriorityDir(x, y, -1, 0, color);
-				fillPriorityDir(x, y, -1, 1, color);
-				fillPriorityDir(x, y, 0, -1, color);
-				fillPriorityDir(x, y, 0, 1, color);
-				fillPriorityDir(x, y, 1, -1, color);
-				fillPriorityDir(x, y, 1, 0, color);
-				fillPriorityDir(x, y, 1, 1, color);
-
-				if (options.capture)
-				{
-					fillCapturePriorityDir(x, y, -1, -1, enemyColor);
-					fillCapturePriorityDir(x, y, -1, 0, enemyColor);
-					fillCapturePriorityDir(x, y, -1, 1, enemyColor);
-					fillCapturePriorityDir(x, y, 0, -1, enemyColor);
-					fillCapturePriorityDir(x, y, 0, 1, enemyColor);
-					fillCapturePriorityDir(x, y, 1, -1, enemyColor);
-					fillCapturePriorityDir(x, y, 1, 0, enemyColor);
-					fillCapturePriorityDir(x, y, 1, 1, enemyColor);
-				}
+				if (forward.cells[i])
+					priority[origin + (bit + 1 + i) * step] += sign * forward.cells[i];
+				if (backward.cells[i])
+					priority[origin + (bit - 1 - i) * step] += sign * backward.cells[i];
+			}
+			if (_cache.capturePriority)
+			{
+				if (forward.capture)
+					priority[origin + (bit + 3) * step] += sign * capturePriority;
+				if (backward.capture)
+					priority[origin + (bit - 3) * step] += sign * capturePriority;
 			}
 		}
 	}
 }
 
-inline Board::Board(PlayerColor player):
+/*
+** Rebuilds the priority map from scratch, setCase keeps it up to date
+** afterwards with the same capture rule.
+*/
+void Board::fillPriority(const Rules& rules)
+{
+	_cache.capturePriority = rules.capture;
+	_cache.valid = false;
+	refreshCache();
+}
+
+void Board::refreshCache() const
+{
+	std::memset(_cache.priority, 0, sizeof(_cache.priority));
+	std::memset(_cache.threes, 0, sizeof(_cache.threes));
+	_cache.score = boardScore();
+	for (int index = 0; index < LINE_COUNT; index++)
+	{
+		spreadPriority(index, ~LineBits(0), 1);
+		if (_cache.doubleThree)
+			markThrees(index, ~LineBits(0));
+	}
+	_cache.valid = true;
+}
+
+Board::Board(PlayerColor player):
 				_data(),
-				_priority(),
+				_hash(),
 				_capturedWhites(),
 				_capturedBlacks(),
 				_turnNum(),
 				_turn(player),
 				_victoryFlag(nullPlayer),
-				_alignmentPos()
+				_alignmentPos(),
+				_cache()
+{
+	_cache.capturePriority = true;
+	_cache.doubleThree = false;
+	_cache.valid = true;
+}
+
+Board::Board(const Board& board): Board(board, true)
+{
+}
+
+// Without its cache, a copy only pays for the stones until it is asked for priorities or score
+Board::Board(const Board& board, bool withCache):
+				_hash(board._hash),
+				_capturedWhites(board._capturedWhites),
+				_capturedBlacks(board._capturedBlacks),
+				_turnNum(board._turnNum),
+				_turn(board._turn),
+				_victoryFlag(board._victoryFlag),
+				_alignmentPos(board._alignmentPos),
+				_victoryState(board._victoryState)
 {
-	_priority[9][9] = 1;
+	std::memcpy(_data, board._data, sizeof(_data));
+	std::memcpy(_captureLines, board._captureLines, sizeof(_captureLines));
+	std::memcpy(_fiveLines, board._fiveLines, sizeof(_fiveLines));
+	_cache.capturePriority = board._cache.capturePriority;
+	_cache.doubleThree = board._cache.doubleThree;
+	_cache.valid = withCache && board._cache.valid;
+	if (_cache.valid)
+	{
+		std::memcpy(_cache.priority, board._cache.priority, sizeof(_cache.priority));
+		std::memcpy(_cache.threes, board._cache.threes, sizeof(_cache.threes));
+		_cache.score = board._cache.score;
+	}
 }
 
-inline Board::Board(const Board& board)
+Board::Board(const Board& board, BoardPos move, PlayerColor player, const Rules& rules) : Board(board)
 {
-	*this = board;
-	bzero(_priority, sizeof(_priority));
+	MoveUndo undo;
+
+	makeMove(move, player, rules, undo);
 }
 
-inline Board::Board(const Board& board, BoardPos move, PlayerColor player, const Options& options) : Board(board)
+void Board::makeMove(BoardPos move, PlayerColor player, const Rules& rules, MoveUndo& undo)
 {
+	undo.move = move;
+	undo.player = player;
+	undo.captureCount = 0;
+	undo.capturedWhites = _capturedWhites;
+	undo.capturedBlacks = _capturedBlacks;
+	undo.turnNum = _turnNum;
+	undo.turn = _turn;
+	undo.victoryFlag = _victoryFlag;
+	undo.alignmentPos = _alignmentPos;
+	undo.victoryState = _victoryState;
+
 	if (player == PlayerColor::whitePlayer)
-		_data[move.y][move.x] = BoardSquare::white;
+		setCase(move.x, move.y, BoardSquare::white);
 	else
-		_data[move.y][move.x] = BoardSquare::black;
+		setCase(move.x, move.y, BoardSquare::black);
 
-	if (options.capture)
+	if (rules.capture)
 	{
-		int captures = playCapture(move.x, move.y);
+		int captures = playCapture(move.x, move.y, &undo);
 		if (player == PlayerColor::whitePlayer)
 			_capturedBlacks += 2 * captures;
 		else
 			_capturedWhites += 2 * captures;
 	}
-	_victoryState = calculateVictory(move, options);
-	_turnNum = board._turnNum + 1;
-	_turn = (PlayerColor) -(board._turn);
+	_victoryState = calculateVictory(move, rules);
+	_turnNum = undo.turnNum + 1;
+	_turn = (PlayerColor) -(undo.turn);
+}
+
+void Board::unmakeMove(const MoveUndo& undo)
+{
+	BoardSquare enemy = (undo.player == PlayerColor::whitePlayer) ? BoardSquare::black : BoardSquare::white;
+
+	setCase(undo.move.x, undo.move.y, BoardSquare::empty);
+	for (int i = 0; i < undo.captureCount; i++)
+		setCase(undo.captured[i].x, undo.captured[i].y, enemy);
+
+	_capturedWhites = undo.capturedWhites;
+	_capturedBlacks = undo.capturedBlacks;
+	_turnNum = undo.turnNum;
+	_turn = undo.turn;
+	_victoryFlag = undo.victoryFlag;
+	_alignmentPos = undo.alignmentPos;
+	_victoryState = undo.victoryState;
 }
 
-inline Board::~Board() { }
+Board::~Board() { }
 
-inline MoveScore Board::getBestPriority() const
+MoveScore Board::getBestPriority() const
 {
 	MoveScore best = MoveScore(-1, BoardPos());
 
@@ -451,5 +946,7 @@ inline MoveScore Board::getBestPriority() const
 		if (p > best.score)
 			best = MoveScore(p, current);
 	}
+	if (best.score <= 0 && getCase(middleX, middleY) == empty)
+		best = MoveScore(1, BoardPos(middleX, middleY));
 	return (best);
 }
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <mutex>
 #include <unistd.h>
 #include "GUIManager.hpp"
 #include "Game.hpp"
@@ -30,12 +31,15 @@ std::string getVictoryMessage(VictoryState v)
 
 void game_page(GUIManager& win, Options &options)
 {
-	Game                g(options);
+	Game                g(options, options.getSearchSettings());
 	bool                hasWon = false;
 	bool 				turn_incr = true;
 	std::string         text("");
 	VictoryState        victory;
 	BoardPos            pos;
+	std::future<BoardPos>	search;
+	std::mutex			progressMutex;
+	std::string			status;
 	turn = 0;
 	
 
@@ -51,10 +55,21 @@ void game_page(GUIManager& win, Options &options)
 			switch (event.type)
 			{
 				case sf::Event::Closed:
+					g.stopPondering();
+					if (search.valid())
+					{
+						g.stopSearch();
+						search.wait();
+					}
 					exit(0);
 				case sf::Event::KeyPressed:
 					if (event.key.code == sf::Keyboard::Escape)
 					{
+						if (search.valid())
+						{
+							g.stopSearch();
+							search.wait();
+						}
 						turn_incr = true;
 						turn = 0;
 						return;
@@ -63,7 +78,7 @@ void game_page(GUIManager& win, Options &options)
 				case sf::Event::MouseButtonPressed:
 					if (hasWon)
 						return;
-					if (g.isPlayerNext() && win.getMouseBoardPos(pos) && !hasWon)
+					if (options.isPlayerNext(g.getTurn()) && win.getMouseBoardPos(pos) && !hasWon)
 					{
 						std::cout << "Player " << (g.getTurn() == whitePlayer ? "white:" : "black:") << std::endl;
 						if (g.play(pos))
@@ -81,45 +96,69 @@ void game_page(GUIManager& win, Options &options)
 			}
 		}
 
-		if (g.isPlayerNext())
+		if (options.isPlayerNext(g.getTurn()))
 			win.drawBoard(g, options, text);
 
-		if (g.getTurn() == PlayerColor::whitePlayer && options.isWhiteAI && !hasWon)
-		{	
-			if (g.play())
+		// The AI thinks on the player's time, play() stops it
+		if (options.isPlayerNext(g.getTurn()) && (options.isWhiteAI || options.isBlackAI) && !hasWon)
+			g.startPondering();
+
+		bool isAITurn = (g.getTurn() == PlayerColor::whitePlayer) ? options.isWhiteAI : options.isBlackAI;
+
+		// The search runs on its own thread, the window keeps answering meanwhile
+		if (isAITurn && !hasWon && !search.valid())
+		{
+			status = "AI thinking...";
+			search = g.startSearch([&](const SearchProgress& progress)
+			{
+				std::lock_guard<std::mutex> lock(progressMutex);
+				status = "AI thinking: depth " + std::to_string(progress.depth) + ", best "
+						+ std::to_string(progress.best.x) + "," + std::to_string(progress.best.y);
+			});
+		}
+		else if (search.valid() && search.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			std::lock_guard<std::mutex> lock(progressMutex);
+			win.drawBoard(g, options, text, status);
+		}
+		else if (search.valid())
+		{
+			bool isWhite = (g.getTurn() == PlayerColor::whitePlayer);
+			BoardPos move = search.get();
+
+			// Every free cell is forbidden to the AI, the game cannot go on
+			if (move == BoardPos::boardEnd())
 			{
 				hasWon = true;
-				victory = g.getState()->getVictory();
+				victory = VictoryState(staleMate);
 				text = getVictoryMessage(victory);
 			}
-			turn_incr = true;
-			std::cout << "AI white:" << std::endl;
-			std::cout << "  Board score: " << g.getCurrentScore() << std::endl;
-			std::cout << "  Time taken: " << g.getTimeTaken() << std::endl;
-			if (text != "") std::cout << text << std::endl;
-			win.drawBoard(g, options, text);
-			shouldWait = false;
-		}
-
-		if (g.getTurn() == PlayerColor::blackPlayer && options.isBlackAI && !hasWon)
-		{
-			if (g.play())
+			else if (g.play(move))
 			{
 				hasWon = true;
 				victory = g.getState()->getVictory();
 				text = getVictoryMessage(victory);
 			}
-			std::cout << "---------------------------" << std::endl;
-			std::cout << "TURN " << ++turn << "!" << std::endl;
-			std::cout << "AI black:" << std::endl;
+			if (isWhite)
+			{
+				turn_incr = true;
+				std::cout << "AI white:" << std::endl;
+			}
+			else
+			{
+				std::cout << "---------------------------" << std::endl;
+				std::cout << "TURN " << ++turn << "!" << std::endl;
+				std::cout << "AI black:" << std::endl;
+			}
 			std::cout << "  Board score: " << g.getCurrentScore() << std::endl;
 			std::cout << "  Time taken: " << g.getTimeTaken() << std::endl;
+			std::cout << "  Depth reached: " << g.getDepthReached() << std::endl;
 			if (text != "") std::cout << text << std::endl;
 			win.drawBoard(g, options, text);
 			shouldWait = false;
 		}
 
-		if (g.getTurn() == PlayerColor::blackPlayer && turn_incr)
+		if (g.getTurn() == PlayerColor::blackPlayer && turn_incr && !isAITurn)
 		{
 			turn_incr = false;
 			std::cout << "---------------------------" << std::endl;
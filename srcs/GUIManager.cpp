@@ -58,7 +58,7 @@ sf::Vector2f	GUIManager::getMouseScreenRatio()
 	return value;
 }
 
-void	GUIManager::drawBoard(Game& g, Options options, const std::string message)
+void	GUIManager::drawBoard(Game& g, Options options, const std::string message, const std::string status)
 {
 	BoardSquare 		c;
 	sf::Sprite			highlight(_textures.highlight);
@@ -73,7 +73,7 @@ void	GUIManager::drawBoard(Game& g, Options options, const std::string message)
 	sf::Text			text_victory;
 
 	Board &b = *g.getState();
-	bool isPlayerNext = g.isPlayerNext();
+	bool isPlayerNext = options.isPlayerNext(g.getTurn());
 
 	BoardPos mousePos;
 	getMouseBoardPos(mousePos);
@@ -180,6 +180,14 @@ void	GUIManager::drawBoard(Game& g, Options options, const std::string message)
 		}
 	}
 
+	// What the AI is up to while it searches
+	if (status.size())
+	{
+		sf::Text	statusText(status, _textures.font, 24);
+		centerOnPos(statusText, _w / 2, _h - 15);
+		draw(statusText);
+	}
+
 	if (message.size())
 	{
 		sf::RectangleShape			wonPopup(sf::Vector2f(_w * 0.8,200));
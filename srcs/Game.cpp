@@ -1,28 +1,113 @@
 #include "Game.hpp"
 #include "ThreadPool.hpp"
 #include "Board.hpp"
-#include <boost/bind.hpp>
+#include "ThreatSolver.hpp"
+#include "MovePicker.hpp"
+#include "SearchControl.hpp"
+#include "ThreadData.hpp"
+#include "TranspositionTable.hpp"
+#include "MoveHistory.hpp"
+#include "Arena.hpp"
 
 using namespace std;
 
 const double timeMargin = 0.005;
+const int minDepth = 2;
+const int maxDepth = 20;
+const double minGrowth = 2;
+const double maxGrowth = 6;
 const int initialWidth = 40;
 const int deepWidth = 20;
-const int threadCount = 8;
+const int splitDepth = 4;
+const int quiescenceDepth = 4;
+const int quiescenceNodes = 16;
+const int lateMoves = 3;
+const int reductionDepth = 3;
+const int quietPriority = 64;
+const Score aspirationWindow = 100;
+const size_t arenaSize = 4 << 20;
+const int vcfDepth = 15;
+const int vctDepth = 5;
+const double solverNodesPerSecond = 10000;
+const int maxPvLength = 16;
+
+// What a search thread keeps to itself: its move ordering memory and scratch arena
+struct Game::ThreadLocal
+{
+	MoveHistory	history;
+	Arena		arena;
+
+	ThreadLocal(size_t arenaSize): history(), arena(arenaSize) {}
+};
+
+// One younger brother of a split point, searched on its own copy of the node
+struct Game::SplitJob : public Job
+{
+	Game*			game;
+	SplitPoint*		split;
+	const Board*	node;
+	BoardPos		move;
+	int				depth;
+	PlayerColor		player;
+
+	void execute()
+	{
+		if (split->isCutoff() || game->isOverdue())
+			return;
+
+		Board board(*node);
+		MoveUndo undo;
+		Score score;
 
-Game::Game(const Options& options) :
-		_options(options),
-		_timeLimit(options.slowMode ? 10 : 0.5),
+		board.makeMove(move, player, game->_rules, undo);
+		if (board.getVictory().type)
+			score = (pinfinity + depth) * (board.getVictory().victor * player);
+		else if (depth <= 1)
+		{
+			int nodes = 0;
+			score = -game->quiesce(board, quiescenceDepth, -split->beta, -split->alpha.load(), -player, nodes);
+		}
+		else
+		{
+			// Younger brothers only need to show they do not beat the best so far
+			Score alpha = split->alpha.load();
+			score = -game->negamax(board, depth - 1, -alpha - 1, -alpha - 1, -player, split);
+			if (score > alpha && score <= split->beta)
+				score = -game->negamax(board, depth - 1, -split->beta, -alpha, -player, split);
+		}
+
+		// A search given up halfway only saw part of the tree
+		if (!split->isCutoff() && !game->isOverdue())
+		{
+			split->update(score, move);
+			if (score > split->beta)
+				game->threadLocal().history.onCutoff(game->_depth - depth, player, depth, nullptr, 0, move);
+		}
+	}
+};
+
+Game::Game(const Rules& rules, const SearchSettings& settings) :
+		_control(new SearchControl()),
+		_rules(rules),
+		_timeLimit(settings.timeLimit),
+		_searchLimit(_timeLimit),
 		_timeTaken(),
-		_constDepth(7 + options.slowMode)
+		_constDepth(maxDepth),
+		_completedDepth(),
+		_ponderDone(false),
+		_ponderHit(false)
 {
 	_turn = PlayerColor::blackPlayer;
 	_depth = _constDepth;
-	std::cout << "depth: " << _depth << std::endl;
 	_state = new Board(_turn);
-	_state->fillTaboo(_options.doubleThree, _turn);
+	_state->fillPriority(_rules);
+	_state->setDoubleThree(_rules.doubleThree);
 	_previousState = nullptr;
-	_pool = new Pool(threadCount);
+	_pool = new Pool(std::max(1u, std::thread::hardware_concurrency()));
+	_table = new TranspositionTable(settings.tableSize, settings.hugePages);
+	_threadData = new std::vector<ThreadData>();
+	for (size_t i = 0; i <= _pool->size(); i++)
+		_locals.push_back(new ThreadLocal(arenaSize));
 
 	std::random_device rd;
 	_randomDevice = std::mt19937(rd());
@@ -30,157 +115,440 @@ Game::Game(const Options& options) :
 
 Game::~Game()
 {
+	stopPondering();
 	delete _pool;
+	delete _table;
+	delete _threadData;
+	for (size_t i = 0; i < _locals.size(); i++)
+		delete _locals[i];
 	delete _state;
 	delete _previousState;
+	delete _control;
 }
 
-Score Game::negamax(Board& node, int negDepth, Score alpha, Score beta, PlayerColor player)
+Score Game::negamax(Board& node, int negDepth, Score alpha, Score beta, PlayerColor player, const SplitPoint* split)
 {
-	MoveScore children[BOARD_HEIGHT * BOARD_WIDTH];
+	const uint64_t key = node.getHash();
+	const Score alphaOrigin = alpha;
+	TableHit hit;
 
-	node.fillPriority(_options);
-	int count = node.getChildren(children, deepWidth);
+	if (_table->probe(key, hit) && hit.depth >= negDepth)
+	{
+		if (hit.bound == boundExact
+			|| (hit.bound == boundLower && hit.score > beta)
+			|| (hit.bound == boundUpper && hit.score < alpha))
+			return hit.score;
+	}
 
-	if (!count)
-		throw std::logic_error("GetChildren returned an empty array");
+	ThreadLocal& local = threadLocal();
+	ArenaScope scope(local.arena);
+	MoveHistory& history = local.history;
+	const int ply = _depth - negDepth;
+	MovePicker picker(node, player, history, local.arena, ply, hit, deepWidth);
+	BoardPos tried[deepWidth];
+	int count = 0;
+	BoardPos pos;
+
+	// Every free cell may be taboo for the mover, the position then stands as it is
+	if (!picker.next(pos))
+		return player * node.getScore(_rules.captureWin);
+
+	// Score of the child for the mover, past the horizon with the quiescence search
+	auto search = [&](int depth, Score low, Score high) -> Score {
+		if (depth <= 0)
+		{
+			int nodes = 0;
+			return -quiesce(node, quiescenceDepth, -high, -low, -player, nodes);
+		}
+		return -negamax(node, depth, -high, -low, -player, split);
+	};
 
-	size_t i;
 	Score bestScore = ninfinity - 100;
-	for (i = 0; i < (unsigned long)count; i++)
+	BoardPos bestMove = pos;
+	do
 	{
-		if (alpha <= beta && !isOverdue())
+		if (alpha > beta || isOverdue() || (split && split->isCutoff()))
+			break;
+
+		// Late quiet moves are tried one ply shallower first
+		bool reduce = count >= lateMoves && negDepth >= reductionDepth && picker.isQuiet(quietPriority);
+		MoveUndo undo;
+		node.makeMove(pos, player, _rules, undo);
+		Score score;
+		if (node.getVictory().type)
 		{
-			BoardPos pos = children[i].pos;
-			Board *board = new Board(node, pos, player, _options);
-			Score score;
-			if (board->getVictory().type)
-			{
-				score = (pinfinity + negDepth) * (board->getVictory().victor * player);
-			}
-			else if (negDepth <= 1)
-			{
-				score = player * board->getScore(_options.captureWin);
-			}
-			else
-			{
-				score = -negamax(*board, negDepth - 1, -beta, -alpha, -player);
-			}
-			bestScore = std::max(bestScore, score);
-			alpha = std::max(alpha, score);
-			delete board;
+			score = (pinfinity + negDepth) * (node.getVictory().victor * player);
+		}
+		else if (!count)
+		{
+			score = search(negDepth - 1, alpha, beta);
 		}
 		else
 		{
+			// Principal variation search: a null window tells whether the move beats alpha
+			score = alpha + 1;
+			if (reduce)
+				score = search(negDepth - 2, alpha + 1, alpha + 1);
+			if (score > alpha)
+				score = search(negDepth - 1, alpha + 1, alpha + 1);
+			if (score > alpha && score <= beta)
+				score = search(negDepth - 1, alpha, beta);
+		}
+		node.unmakeMove(undo);
+		if (score > bestScore)
+		{
+			bestScore = score;
+			bestMove = pos;
+		}
+		alpha = std::max(alpha, score);
+		if (alpha > beta)
+			history.onCutoff(ply, player, negDepth, tried, count, pos);
+		tried[count++] = pos;
+#ifndef NON_THREADED
+		// Young brothers wait: the rest is searched in parallel once the eldest has set the bounds
+		if (count == 1 && negDepth >= splitDepth && alpha <= beta)
+		{
+			MoveScore rest[deepWidth];
+			int restCount = 0;
+
+			while (picker.next(pos))
+				rest[restCount++] = MoveScore(0, pos);
+			if (restCount)
+			{
+				SplitPoint point(split, alpha, beta, bestScore, bestMove);
+
+				search_split(point, node, rest, restCount, negDepth, player);
+				bestScore = point.bestScore;
+				bestMove = point.bestMove;
+			}
 			break;
 		}
+#endif
 	}
+	while (picker.next(pos));
 
+	// A search cut by the clock or by a split point above did not see every child
+	if (!isOverdue() && !(split && split->isCutoff()))
+	{
+		BoundType bound = boundExact;
+		if (bestScore <= alphaOrigin)
+			bound = boundUpper;
+		else if (bestScore > beta)
+			bound = boundLower;
+		_table->store(key, negDepth, bound, bestScore, true, bestMove);
+	}
 	return bestScore;
 }
 
-MoveScore Game::negamax_thread(ThreadData data)
+/*
+** Past the horizon only forcing moves are searched: blocks when the enemy
+** threatens a five, captures when a five waits to be broken, and otherwise
+** fives, captures and fours, the static score standing for the quiet moves.
+*/
+Score Game::quiesce(Board& node, int depth, Score alpha, Score beta, PlayerColor player, int& nodes)
+{
+	PlayerColor enemy = -player;
+	Score standPat = player * node.getScore(_rules.captureWin);
+	Arena& arena = threadLocal().arena;
+	ArenaScope scope(arena);
+	CellList& moves = *new (arena.allocate<CellList>(1)) CellList();
+	bool forced = true;
+
+	if (node.isFlaggedFinal())
+	{
+		ThreatSolver::captureMoves(node, player, moves);
+		if (!moves.count)
+			return -pinfinity;
+	}
+	else
+	{
+		ThreatSolver::fiveMoves(node, player, moves);
+		int wins = moves.count;
+		ThreatSolver::fiveMoves(node, enemy, moves);
+		forced = !wins && moves.count;
+		if (_rules.capture)
+			ThreatSolver::captureMoves(node, player, moves);
+		if (!forced)
+			ThreatSolver::fourMoves(node, player, moves);
+	}
+
+	if (!forced && standPat > beta)
+		return standPat;
+	if (!forced)
+		alpha = std::max(alpha, standPat);
+
+	Score bestScore = forced ? ninfinity - 100 : standPat;
+	for (int i = 0; i < moves.count && depth > 0 && alpha <= beta && nodes < quiescenceNodes; i++)
+	{
+		BoardPos pos = moves.cells[i];
+		MoveUndo undo;
+		Score score;
+
+		if (node.isTaboo(pos.x, pos.y))
+			continue;
+		nodes++;
+		node.makeMove(pos, player, _rules, undo);
+		if (node.getVictory().type)
+			score = pinfinity * (node.getVictory().victor * player);
+		else
+			score = -quiesce(node, depth - 1, -beta, -alpha, enemy, nodes);
+		node.unmakeMove(undo);
+		bestScore = std::max(bestScore, score);
+		alpha = std::max(alpha, score);
+	}
+	// Out of depth or nodes before answering a threat
+	if (bestScore < ninfinity)
+		return standPat;
+	return bestScore;
+}
+
+void Game::search_split(SplitPoint& split, const Board& node, const MoveScore* moves, int count, int depth, PlayerColor player)
+{
+	SplitJob jobs[deepWidth];
+	TaskGroup group(*_pool);
+
+	for (int i = 0; i < count; i++)
+	{
+		jobs[i].game = this;
+		jobs[i].split = &split;
+		jobs[i].node = &node;
+		jobs[i].move = moves[i].pos;
+		jobs[i].depth = depth;
+		jobs[i].player = player;
+		group.spawn(jobs[i]);
+	}
+	group.wait();
+}
+
+MoveScore Game::negamax_thread(const ThreadData& data, bool pv)
 {
 	Score score;
 
-	Board* board = data.node.board;
-	BoardPos pos = data.node.move;
+	BoardPos pos = data.move;
+	PlayerColor player = data.player;
 
 	if (isOverdue())
-	{
-		delete board;
 		return MoveScore(ninfinity, pos);
-	}
 	if (data.alpha->load() > pinfinity)
-	{
-		delete board;
 		return MoveScore(ninfinity, pos);
-	}
 
-	std::atomic<Score>* alpha = data.alpha;
+	Score alpha = data.alpha->load();
+
+	// Each root move is searched on its own board, moves below are made and unmade in place
+	Board board(*data.node);
+	MoveUndo undo;
+	board.makeMove(pos, player, _rules, undo);
 
-	if (board->getVictory().type)
+	if (board.getVictory().type)
 	{
-		score = (pinfinity + _depth) * (board->getVictory().victor * data.player);
+		score = (pinfinity + _depth) * (board.getVictory().victor * player);
+	}
+	else if (pv)
+	{
+		score = -negamax(board, _depth - 1, -data.beta, -alpha, -player, nullptr);
 	}
 	else
 	{
-		score = -negamax(*board, _depth - 1, ninfinity, -alpha->load(), -data.player);
+		// A root move equal to the best is searched again too, ties are played at random
+		score = -negamax(board, _depth - 1, -alpha, -alpha, -player, nullptr);
+		if (score >= alpha && score < data.beta && !isOverdue())
+			score = -negamax(board, _depth - 1, -data.beta, -alpha, -player, nullptr);
 	}
 
-	alpha->store(std::max(alpha->load(), score));
+	atomicMax(*data.alpha, score);
 
-	delete board;
 	return (MoveScore(score, pos));
 }
 
+void Game::negamax_root(Board *node, PlayerColor player, const std::vector<MoveScore>& moves, Score alpha, Score beta, std::vector<MoveScore>& result)
+{
+	std::atomic<Score> sharedAlpha(alpha);
+	std::vector<ThreadData>& threadData = *_threadData;
+
+	// Both vectors keep their room from one depth and one move to the next
+	threadData.resize(moves.size());
+	for (size_t i = 0; i < moves.size(); i++)
+	{
+		threadData[i] = ThreadData(node, moves[i].pos, &sharedAlpha, beta, player);
+	}
+
+	result.resize(threadData.size());
+#ifdef NON_THREADED
+	for (size_t i = 0; i < threadData.size(); i++)
+	{
+		result[i] = negamax_thread(threadData[i], i == 0);
+	}
+#else
+	// The best move of the previous depth comes first and gives the others their bound
+	result[0] = negamax_thread(threadData[0], true);
+	_pool->parallelFor(1, threadData.size(), [&](size_t i) {
+		result[i] = negamax_thread(threadData[i], false);
+	});
+#endif
+}
+
+/*
+** Iterative deepening: every completed depth replaces the chosen move and
+** orders the root moves of the next one, the transposition table ordering
+** the moves below. A depth cut by the clock is thrown away, and no depth
+** is started when the previous ones say it cannot finish in time.
+*/
 BoardPos Game::start_negamax(Board *node, PlayerColor player)
 {
-	std::atomic<Score> alpha(ninfinity);
 	MoveScore children[BOARD_HEIGHT * BOARD_WIDTH];
 
 	int count = node->getChildren(children, initialWidth);
 
+	// Every free cell may be taboo for the mover, there is then no move to give
 	if (!count)
-		throw std::logic_error("GetChildren returned an empty array");
+	{
+		_pv.clear();
+		return BoardPos::boardEnd();
+	}
 
-	std::vector<ThreadData> threadData(count);
+	// A forced win found by the threat solver needs no search
+	ThreatSolver solver(_rules, solverNodesPerSecond * _timeLimit, _control);
+	// The solver reads stones only, its copy leaves the priority cache behind
+	Board board(*node, false);
+	BoardPos win;
 
-	for (size_t i = 0; i < (unsigned long)count; i++)
+	if (solver.solveVCF(board, player, vcfDepth, win) || solver.solveVCT(board, player, vctDepth, win))
 	{
-		threadData[i] =	ThreadData(
-				ChildBoard(
-						new Board(*node, children[i].pos, player, _options),
-						children[i].pos),
-				&alpha,
-				player);
+		_pv.assign(1, win);
+		return win;
 	}
 
+	std::vector<MoveScore> moves(children, children + count);
 
-	std::function<MoveScore(ThreadData)> function = boost::bind(&Game::negamax_thread, this, _1);
-#ifdef NON_THREADED
-	std::vector<MoveScore> result;
-	result.resize(threadData.size());
-	for (size_t i = 0; i < threadData.size(); i++)
+	// The move the last search expected here is searched first
+	if (!_pv.empty())
 	{
-		result[i] = function(threadData[i]);
+		std::vector<MoveScore>::iterator expected = std::find_if(moves.begin(), moves.end(),
+				[this](const MoveScore& move) { return move.pos == _pv[0]; });
+
+		if (expected != moves.end())
+			std::rotate(moves.begin(), expected, expected + 1);
+		else if (node->getPriority(_pv[0]) >= 0 && node->getCase(_pv[0]) == BoardSquare::empty)
+			moves.insert(moves.begin(), MoveScore(0, _pv[0]));
 	}
-#else
-	std::vector<MoveScore> result = _pool->run(function, threadData);
-#endif
+	std::vector<MoveScore> result;
+	BoardPos bestPos = moves[0].pos;
+	double previousTime = 0;
+	// Scores of the last completed odd and even depths, the evaluation swinging with parity
+	Score previousScores[2] = {0, 0};
 
-	MoveScore bestMove(ninfinity - 100);
-	std::vector<MoveScore>	choice;
-	for (size_t i = 0; i < result.size(); i++)
+	for (int depth = minDepth; depth <= _constDepth; depth++)
 	{
-		MoveScore move = result[i];
+		double iterationStart = getTimeDiff();
+		Score alpha = ninfinity;
+		Score beta = pinfinity;
 
-		if (move.score > bestMove.score)
+		// Aspiration window: a side the best score falls out of is searched again without bound
+		if (depth >= minDepth + 2)
 		{
-			choice.clear();
-			bestMove = move;
-			choice.push_back(bestMove);
+			alpha = previousScores[depth & 1] - aspirationWindow;
+			beta = previousScores[depth & 1] + aspirationWindow;
 		}
-		else if (move.score == bestMove.score && move.score > ninfinity)
+		_depth = depth;
+		while (true)
 		{
-			bestMove = move;
-			choice.push_back(bestMove);
+			negamax_root(node, player, moves, alpha, beta, result);
+			if (isOverdue())
+				break;
+
+			Score best = std::max_element(result.begin(), result.end(),
+					[](const MoveScore& a, const MoveScore& b) { return a.score < b.score; })->score;
+			if (best < alpha && alpha > ninfinity)
+				alpha = ninfinity;
+			else if (best >= beta && beta < pinfinity)
+				beta = pinfinity;
+			else
+				break;
 		}
+		if (isOverdue())
+			break;
+
+		MoveScore bestMove(ninfinity - 100);
+		std::vector<MoveScore>	choice;
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			MoveScore move = result[i];
+
+			if (move.score > bestMove.score)
+			{
+				choice.clear();
+				bestMove = move;
+				choice.push_back(bestMove);
+			}
+			else if (move.score == bestMove.score && move.score > ninfinity)
+			{
+				bestMove = move;
+				choice.push_back(bestMove);
+			}
+		}
+
+		std::uniform_int_distribution<int> uni(0, choice.size() - 1);
+		bestPos = choice[uni(_randomDevice)].pos;
+		_completedDepth = depth;
+		previousScores[depth & 1] = bestMove.score;
+		if (_onProgress)
+			_onProgress(SearchProgress{depth, bestMove.score, bestPos, getTimeDiff()});
+
+		// A won or lost position will not change deeper
+		if (bestMove.score >= pinfinity || bestMove.score <= ninfinity)
+			break;
+
+		std::stable_sort(result.begin(), result.end(),
+				[](const MoveScore& a, const MoveScore& b) { return a.score > b.score; });
+		moves = result;
+
+		double now = getTimeDiff();
+		double iterationTime = now - iterationStart;
+		double growth = previousTime > 0 ? iterationTime / previousTime : maxGrowth;
+		growth = CLAMP(growth, minGrowth, maxGrowth);
+		if (now + iterationTime * growth > _searchLimit - timeMargin)
+			break;
+		previousTime = iterationTime;
 	}
+	store_pv(*node, player, bestPos);
+	return bestPos;
+}
 
-	std::uniform_int_distribution<int> uni(0, choice.size() - 1);
-	return choice[uni(_randomDevice)].pos;
+// Follows the table moves from the chosen one, for the next search to start with
+void Game::store_pv(const Board& node, PlayerColor player, BoardPos best)
+{
+	Board board(node);
+	MoveUndo undo;
+	TableHit hit;
+
+	_pv.assign(1, best);
+	board.makeMove(best, player, _rules, undo);
+	while (_pv.size() < size_t(maxPvLength) && !board.getVictory().type
+		&& _table->probe(board.getHash(), hit) && hit.hasMove
+		&& board.getCase(hit.move) == BoardSquare::empty && board.getPriority(hit.move) >= 0)
+	{
+		player = -player;
+		_pv.push_back(hit.move);
+		board.makeMove(hit.move, player, _rules, undo);
+	}
 }
 
 
-bool Game::isOverdue() const
+// Worker 0 of the pool uses the second entry, threads outside it the first one
+Game::ThreadLocal& Game::threadLocal()
 {
-	using namespace std;
-	auto current = std::chrono::high_resolution_clock::now();
+	return *_locals[_pool->workerIndex() + 1];
+}
 
-	double difference = std::chrono::duration_cast<std::chrono::milliseconds>(current - _start).count();
+bool Game::isOverdue() const
+{
+	return _control->isStopped();
+}
 
-	return difference > (_timeLimit - timeMargin) * 1000;
+// Ends the current search as soon as possible, with the best move of the last completed depth
+void Game::stopSearch()
+{
+	_control->stop();
 }
 
 double Game::getTimeDiff() const
@@ -190,36 +558,150 @@ double Game::getTimeDiff() const
 	return difference;
 }
 
-BoardPos Game::getNextMove()
+void Game::prepare_search()
 {
 	_start = std::chrono::high_resolution_clock::now();
+	_table->newSearch();
+	for (size_t i = 0; i < _locals.size(); i++)
+	{
+		_locals[i]->history.age();
+		_locals[i]->arena.reset();
+	}
+	_completedDepth = 0;
+}
+
+BoardPos Game::getNextMove()
+{
+	// A pondered answer that had the time of a normal search, or ended on its own, is played at once
+	if (_ponderHit)
+	{
+		_ponderHit = false;
+		_timeTaken = 0;
+		return _ponderReply;
+	}
+
+	arm_search();
+	return run_search();
+}
 
+// Starts the clock of a normal search, on the thread that asks for the move
+void Game::arm_search()
+{
+	prepare_search();
+	_searchLimit = _timeLimit;
+	_control->start(_timeLimit - timeMargin);
+}
+
+BoardPos Game::run_search()
+{
 	BoardPos pos = start_negamax(_state, _turn);
 
+	_control->finish();
 	_timeTaken = getTimeDiff();
 
 	return pos;
 }
 
+/*
+** The GUI keeps drawing and polling events while the move is searched: the
+** callback hears of every completed depth, the future gets the move, and
+** the game is only changed by the caller playing it.
+*/
+std::future<BoardPos> Game::startSearch(ProgressCallback onProgress)
+{
+	// Armed before the thread exists, so a stopSearch right after this call holds
+	bool searching = !_ponderHit;
+
+	_onProgress = onProgress;
+	if (searching)
+		arm_search();
+	return std::async(std::launch::async, [this, searching]()
+	{
+		BoardPos pos = searching ? run_search() : getNextMove();
+		_onProgress = ProgressCallback();
+		return pos;
+	});
+}
+
+/*
+** Plays the move the last search expects from the other player on a copy
+** and searches the answer without a time limit, until stopPondering. The
+** table, history and line it leaves are those of the position after the
+** expected move.
+*/
+void Game::startPondering()
+{
+	if (_ponderThread.joinable() || _pv.empty() || _state->getVictory().type)
+		return;
+
+	BoardPos expected = _pv[0];
+	if (_state->getCase(expected) != BoardSquare::empty || _state->getPriority(expected) < 0)
+		return;
+
+	Board* node = new Board(*_state, expected, _turn, _rules);
+	if (node->getVictory().type)
+	{
+		delete node;
+		return;
+	}
+
+	PlayerColor player = -_turn;
+	_ponderMove = expected;
+	_ponderDone = false;
+	prepare_search();
+	_searchLimit = std::numeric_limits<double>::infinity();
+	_control->start();
+	_ponderThread = std::thread([this, node, player]()
+	{
+		_ponderReply = start_negamax(node, player);
+		_ponderDone = !isOverdue();
+		delete node;
+	});
+}
+
+void Game::stopPondering()
+{
+	if (!_ponderThread.joinable())
+		return;
+	_control->stop();
+	_ponderThread.join();
+	_control->finish();
+}
+
 Score Game::getCurrentScore() const
 {
-	return _state->getScore(_options.captureWin);
+	return _state->getScore(_rules.captureWin);
 }
 
 bool Game::play(BoardPos pos)
 {
+	if (pos.x < 0 || pos.x >= BOARD_WIDTH || pos.y < 0 || pos.y >= BOARD_HEIGHT)
+		return false;
 	if (_state->getCase(pos) != BoardSquare::empty)
 		return false;
 	if (_state->getPriority(pos) < 0)
 		return false;
 
+	// Keeps what the last search expects after this move, unless it expected another one
+	if (_ponderThread.joinable())
+	{
+		stopPondering();
+		bool hit = (pos == _ponderMove && _completedDepth > 0);
+		_ponderHit = hit && (_ponderDone || getTimeDiff() >= _timeLimit);
+		// On a hit the line is already the one of the pondered answer
+		if (!hit)
+			_pv.clear();
+	}
+	else if (!_pv.empty() && _pv[0] == pos)
+		_pv.erase(_pv.begin());
+	else
+		_pv.clear();
+
 	delete _previousState;
 	_previousState = _state;
-	_state = new Board(*_previousState, pos, _turn, _options);
+	_state = new Board(*_previousState, pos, _turn, _rules);
 
 	_turn = -_turn;
-	_state->fillTaboo(_options.doubleThree, _turn);
-	_state->fillPriority(_options);
 
 	return _state->getVictory().type;
 }
@@ -236,16 +718,14 @@ double Game::getTimeTaken() const
 	return _timeTaken;
 }
 
-bool Game::play()
+int Game::getDepthReached() const
 {
-	return play(getNextMove());
+	return _completedDepth;
 }
 
-bool Game::isPlayerNext() const
+bool Game::play()
 {
-	return
-		(!_options.isBlackAI && getTurn() == blackPlayer) ||
-		(!_options.isWhiteAI && getTurn() == whitePlayer);
+	return play(getNextMove());
 }
 
 Board *Game::getState()
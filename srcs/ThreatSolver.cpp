@@ -0,0 +1,301 @@
+#include "ThreatSolver.hpp"
+
+/*
+** Adds the empty cells of every window of `size` cells holding `stones`
+** of the player's stones and none of the enemy's. With `openEnds` the end
+** cells of the window must be empty too, and only the inner cells are
+** added unless `withEnds` is set.
+*/
+static void scanWindows(const Board& board, PlayerColor player, int size, int stones,
+		bool openEnds, bool withEnds, CellList& list)
+{
+	const BoardData& data = *board.getData();
+	const LineTable& lines = LineTable::get();
+	const int color = (player == whitePlayer);
+
+	for (int index = 0; index < LINE_COUNT; index++)
+	{
+		BoardLine line(index, 0);
+		LineBits allied = data[color][index];
+		LineBits enemy = data[!color][index];
+
+		if (!allied)
+			continue;
+		for (int first = lines.first[index]; first + size - 1 <= lines.last[index]; first++)
+		{
+			LineBits window = ((LineBits(1) << size) - 1) << first;
+			LineBits ends = (LineBits(1) << first) | (LineBits(1) << (first + size - 1));
+			LineBits cells = window;
+
+			if ((enemy & window) || __builtin_popcount(allied & window) != stones)
+				continue;
+			if (openEnds)
+			{
+				if (allied & ends)
+					continue;
+				if (!withEnds)
+					cells &= ~ends;
+			}
+			for (LineBits rest = cells & ~allied; rest; rest &= rest - 1)
+			{
+				BoardLine cell = line.at(__builtin_ctz(rest));
+				list.add(cell.x(), cell.y());
+			}
+		}
+	}
+}
+
+// Adds the cells where a stone of the player makes one of the pattern classes, line by line
+static void scanPatterns(const Board& board, PlayerColor player, int classes, CellList& list)
+{
+	const BoardData& data = *board.getData();
+	const int color = (player == whitePlayer);
+
+	for (int index = 0; index < LINE_COUNT; index++)
+	{
+		BoardLine line(index, 0);
+
+		if (!data[color][index])
+			continue;
+		for (LineBits cells = board.getPatternCells(index, player, classes); cells; cells &= cells - 1)
+		{
+			BoardLine cell = line.at(__builtin_ctz(cells));
+			list.add(cell.x(), cell.y());
+		}
+	}
+}
+
+// Cells completing five stones in a row
+void ThreatSolver::fiveMoves(const Board& board, PlayerColor player, CellList& list)
+{
+	scanPatterns(board, player, patternFive, list);
+}
+
+// Cells leaving four stones and an empty cell in a five cells window
+void ThreatSolver::fourMoves(const Board& board, PlayerColor player, CellList& list)
+{
+	scanPatterns(board, player, patternFour | patternBrokenFour, list);
+}
+
+// Cells making a free three, as Board::checkFreeThree sees them
+void ThreatSolver::threeMoves(const Board& board, PlayerColor player, CellList& list)
+{
+	scanPatterns(board, player, patternFreeThree, list);
+}
+
+/*
+** Empty cells of the player's free threes, one of which stops the open four.
+** The ends of the six cells windows count, which reach past the nine cells
+** the pattern table sees around a cell, so these are still scanned.
+*/
+void ThreatSolver::threeDefences(const Board& board, PlayerColor player, CellList& list)
+{
+	scanWindows(board, player, 6, 3, true, true, list);
+}
+
+// Cells where the player takes a pair of enemy stones
+void ThreatSolver::captureMoves(const Board& board, PlayerColor player, CellList& list)
+{
+	board.getCaptureLines(player).forEach([&](int index)
+	{
+		BoardLine line(index, 0);
+
+		for (LineBits cells = board.getCaptureCells(index, player); cells; cells &= cells - 1)
+		{
+			BoardLine cell = line.at(__builtin_ctz(cells));
+			list.add(cell.x(), cell.y());
+		}
+	});
+}
+
+ThreatSolver::ThreatSolver(const Rules& rules, size_t nodeLimit, const SearchControl* control):
+		_rules(rules),
+		_nodeLimit(nodeLimit),
+		_nodes(),
+		_control(control)
+{
+}
+
+// Counts a node, out of budget or stopped the solver finds no win
+bool ThreatSolver::isExhausted()
+{
+	return ++_nodes > _nodeLimit || (_control && _control->isStopped());
+}
+
+bool ThreatSolver::solveVCF(Board& board, PlayerColor attacker, int depth, BoardPos& move)
+{
+	return solve(board, attacker, depth, false, move);
+}
+
+bool ThreatSolver::solveVCT(Board& board, PlayerColor attacker, int depth, BoardPos& move)
+{
+	return solve(board, attacker, depth, true, move);
+}
+
+/*
+** Deepens one threat at a time so the shortest win is found first and a
+** wide tree of threes does not eat the budget before a short four line.
+** A five waiting to be broken is left to negamax.
+*/
+bool ThreatSolver::solve(Board& board, PlayerColor attacker, int depth, bool threes, BoardPos& move)
+{
+	_nodes = 0;
+	if (board.isFlaggedFinal())
+		return false;
+	for (int current = 1; current <= depth && _nodes < _nodeLimit; current++)
+		if (attack(board, attacker, current, threes, &move))
+			return true;
+	return false;
+}
+
+bool ThreatSolver::isForbidden(const Board& board, BoardPos pos, PlayerColor player) const
+{
+	if (!_rules.doubleThree)
+		return false;
+
+	BoardSquare enemy = (player == whitePlayer) ? black : white;
+	int count = 0;
+
+	for (int dir = 0; dir < LINE_DIRECTIONS && count < 2; dir++)
+		if (board.checkFreeThree(pos.x, pos.y, static_cast<LineDirection>(dir), enemy))
+			count++;
+	return count >= 2;
+}
+
+/*
+** Attacker to move: wins with a five (or the last capture), or with a
+** threat every answer of the defender loses to. `depth` counts the
+** threats the attacker may still play.
+*/
+bool ThreatSolver::attack(Board& board, PlayerColor attacker, int depth, bool threes, BoardPos* move)
+{
+	PlayerColor defender = -attacker;
+	CellList threats;
+
+	if (isExhausted())
+		return false;
+
+	fiveMoves(board, attacker, threats);
+	int fives = threats.count;
+	if (_rules.captureWin)
+	{
+		int captured = (attacker == whitePlayer) ? board.getCapturedBlack() : board.getCapturedWhite();
+		if (captured + 2 >= captureVictoryPoints)
+			captureMoves(board, attacker, threats);
+	}
+	int finishers = threats.count;
+
+	// A five of the defender comes first, only a block that is a four keeps the initiative
+	CellList blocks;
+	fiveMoves(board, defender, blocks);
+	if (!blocks.count && depth > 0)
+	{
+		fourMoves(board, attacker, threats);
+		if (threes)
+			threeMoves(board, attacker, threats);
+	}
+
+	for (int i = 0; i < threats.count; i++)
+	{
+		BoardPos pos = threats.cells[i];
+		bool finisher = i < finishers;
+
+		if (isForbidden(board, pos, attacker))
+			continue;
+
+		MoveUndo undo;
+		board.makeMove(pos, attacker, _rules, undo);
+		VictoryState victory = board.getVictory();
+		bool win;
+		if (victory.type)
+			win = victory.type != staleMate && victory.victor == attacker;
+		else if (i < fives)
+			win = defend(board, attacker, depth, threes);
+		else
+			win = !finisher && defend(board, attacker, depth - 1, threes);
+		board.unmakeMove(undo);
+
+		if (win)
+		{
+			if (move)
+				*move = pos;
+			return true;
+		}
+	}
+
+	if (blocks.count == 1 && depth > 0)
+	{
+		BoardPos pos = blocks.cells[0];
+
+		if (isForbidden(board, pos, attacker))
+			return false;
+
+		MoveUndo undo;
+		board.makeMove(pos, attacker, _rules, undo);
+		CellList fours;
+		fiveMoves(board, attacker, fours);
+		bool win = !board.getVictory().type && fours.count && defend(board, attacker, depth - 1, threes);
+		board.unmakeMove(undo);
+
+		if (win && move)
+			*move = pos;
+		return win;
+	}
+	return false;
+}
+
+/*
+** Defender to move after a threat: answers a pending five with captures,
+** a four with its blocks and captures, a free three with its defence cells,
+** captures and fours of their own. The attacker wins when every answer
+** loses.
+*/
+bool ThreatSolver::defend(Board& board, PlayerColor attacker, int depth, bool threes)
+{
+	PlayerColor defender = -attacker;
+	CellList replies;
+
+	if (isExhausted())
+		return false;
+
+	// With captures on, a five only wins if the defender cannot break it
+	if (!board.isFlaggedFinal())
+	{
+		fiveMoves(board, attacker, replies);
+		if (!replies.count)
+		{
+			if (!threes)
+				return false;
+			threeDefences(board, attacker, replies);
+			if (!replies.count)
+				return false;
+			fourMoves(board, defender, replies);
+		}
+	}
+	if (_rules.capture)
+		captureMoves(board, defender, replies);
+
+	for (int i = 0; i < replies.count; i++)
+	{
+		BoardPos pos = replies.cells[i];
+
+		if (isForbidden(board, pos, defender))
+			continue;
+
+		MoveUndo undo;
+		board.makeMove(pos, defender, _rules, undo);
+		VictoryState victory = board.getVictory();
+		bool lost;
+		if (victory.type)
+			lost = victory.type != staleMate && victory.victor == attacker;
+		else if (board.isFlaggedFinal())
+			lost = false; // a five of the defender, the attacker would have to break it
+		else
+			lost = attack(board, attacker, depth, threes, nullptr);
+		board.unmakeMove(undo);
+
+		if (!lost)
+			return false;
+	}
+	return true;
+}
@@ -0,0 +1,41 @@
+#include "TranspositionTable.hpp"
+#include <new>
+#include <cstring>
+#include <sys/mman.h>
+
+TranspositionTable::TranspositionTable(size_t megabytes, bool hugePages):
+		_entries(),
+		_mask(),
+		_bytes(),
+		_generation()
+{
+	size_t count = 1;
+
+	while (count * 2 * sizeof(Entry) <= megabytes * 1024 * 1024)
+		count *= 2;
+	_mask = count - 1;
+	_bytes = count * sizeof(Entry);
+
+	// Anonymous pages come zeroed, which is an empty table
+	void* memory = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED)
+		throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+	if (hugePages)
+		madvise(memory, _bytes, MADV_HUGEPAGE);
+#else
+	(void)hugePages;
+#endif
+	_entries = static_cast<Entry*>(memory);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+	munmap(_entries, _bytes);
+}
+
+void TranspositionTable::clear()
+{
+	std::memset(static_cast<void*>(_entries), 0, _bytes);
+	_generation = 0;
+}
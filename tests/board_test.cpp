@@ -0,0 +1,82 @@
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <random>
+#include "Engine.hpp"
+
+static int	failures = 0;
+
+static void	check(bool condition, const char* what, int game, int move)
+{
+	if (condition)
+		return;
+	std::printf("game %d move %d: %s\n", game, move, what);
+	failures++;
+}
+
+/*
+** A copy made without the cache rebuilds it on first use, and must not
+** see whatever the memory it lives in held before.
+*/
+static bool	sameTaboos(const Board& board)
+{
+	alignas(Board) unsigned char raw[sizeof(Board)];
+
+	std::memset(raw, 0xFF, sizeof(raw));
+	Board* copy = new (raw) Board(board, false);
+	bool same = true;
+
+	for (int y = 0; y < BOARD_HEIGHT; y++)
+		for (int x = 0; x < BOARD_WIDTH; x++)
+			same = same && copy->isTaboo(x, y) == board.isTaboo(x, y);
+	copy->~Board();
+	return same;
+}
+
+/*
+** The copy scores the whole board in one go, with the AVX2 kernel where
+** the CPU has it, the original adds up setCase's scalar line updates.
+*/
+static bool	sameScore(const Board& board)
+{
+	Board copy(board, false);
+
+	return copy.getScore(false) == board.getScore(false);
+}
+
+// Plays random games and checks the cache against the position at each move
+int	main()
+{
+	std::mt19937 random(42);
+	Rules rules;
+	Board start(blackPlayer);
+
+	// The games below start from this score, the copies must not share its errors
+	start.fillPriority(rules);
+	check(start.getScore(false) == 0, "an empty board does not score 0", -1, 0);
+
+	for (int game = 0; game < 200; game++)
+	{
+		Board board(blackPlayer);
+		PlayerColor player = blackPlayer;
+
+		board.fillPriority(rules);
+		board.setDoubleThree(true);
+		for (int move = 0; move < 120 && board.getVictory().type == novictory; move++)
+		{
+			// Clustered moves make threes and captures far more often than uniform ones
+			std::uniform_int_distribution<int> cell(5, 13);
+			BoardPos pos(cell(random), cell(random));
+			MoveUndo undo;
+
+			if (board.getCase(pos) != empty || board.isTaboo(pos.x, pos.y))
+				continue;
+			board.makeMove(pos, player, rules, undo);
+			player = -player;
+			check(sameTaboos(board), "a copy without cache sees other taboo cells", game, move);
+			check(sameScore(board), "the full board score differs from the incremental one", game, move);
+		}
+	}
+	std::printf("%s\n", failures ? "FAILED" : "OK");
+	return failures != 0;
+}